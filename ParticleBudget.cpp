@@ -0,0 +1,138 @@
+#include "ParticleBudget.h"
+#include <algorithm>
+
+ParticleBudget& ParticleBudget::getInstance()
+{
+    static ParticleBudget budget;
+    return budget;
+}
+
+void ParticleBudget::add(ParticleSystem* system)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    systems_.push_back(system);
+}
+
+void ParticleBudget::remove(ParticleSystem* system)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find(systems_.begin(), systems_.end(), system);
+    if (it != systems_.end())
+    {
+        *it = systems_.back();
+        systems_.pop_back();
+    }
+}
+
+void ParticleBudget::setLimit(int limit)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    limit_ = (std::max)(0, limit);
+}
+
+int ParticleBudget::getSystemCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return int(systems_.size());
+}
+
+void ParticleBudget::update()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int n = int(systems_.size());
+    spend_ = 0;
+    demand_ = 0;
+    for (auto s : systems_)
+    {
+        spend_ += s->getLiveParticleCount();
+        demand_ += s->getTotalParticles();
+    }
+    if (limit_ <= 0 || demand_ <= limit_)
+    {
+        for (auto s : systems_)
+        {
+            s->setBudgetScale(1);
+        }
+        assigned_ = demand_;
+        return;
+    }
+
+    quotas_.assign(n, 0);
+    weights_.resize(n);
+    order_.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        order_[i] = i;
+        weights_[i] = systems_[i]->getTotalParticles() / (1 + (std::max)(0.0f, systems_[i]->getDistance()) / falloff_distance_);
+    }
+    std::sort(order_.begin(), order_.end(), [this](int l, int r) { return systems_[l]->getPriority() > systems_[r]->getPriority(); });
+
+    float left = float(limit_);
+    for (int begin = 0; begin < n && left > 0;)
+    {
+        int priority = systems_[order_[begin]]->getPriority();
+        int end = begin;
+        float demand = 0;
+        while (end < n && systems_[order_[end]]->getPriority() == priority)
+        {
+            demand += systems_[order_[end]]->getTotalParticles();
+            end++;
+        }
+        if (demand <= left)
+        {
+            for (int k = begin; k < end; k++)
+            {
+                quotas_[order_[k]] = float(systems_[order_[k]]->getTotalParticles());
+            }
+            left -= demand;
+            begin = end;
+            continue;
+        }
+        //water filling: share by the weights, a system never gets more than it requests, what it leaves is shared again
+        bool capped = true;
+        while (capped && left > 0)
+        {
+            capped = false;
+            float weight = 0;
+            for (int k = begin; k < end; k++)
+            {
+                int i = order_[k];
+                if (quotas_[i] < systems_[i]->getTotalParticles())
+                {
+                    weight += weights_[i];
+                }
+            }
+            if (weight <= 0)
+            {
+                break;
+            }
+            float share = left;
+            for (int k = begin; k < end; k++)
+            {
+                int i = order_[k];
+                float request = float(systems_[i]->getTotalParticles());
+                if (quotas_[i] >= request)
+                {
+                    continue;
+                }
+                float q = share * weights_[i] / weight;
+                if (quotas_[i] + q >= request)
+                {
+                    q = request - quotas_[i];
+                    capped = true;
+                }
+                quotas_[i] += q;
+                left -= q;
+            }
+        }
+        break;
+    }
+
+    assigned_ = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int total = systems_[i]->getTotalParticles();
+        systems_[i]->setBudgetScale(total > 0 ? quotas_[i] / total : 1);
+        assigned_ += int(quotas_[i]);
+    }
+}
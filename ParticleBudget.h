@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ParticleSystem.h"
+#include <mutex>
+
+/** A budget of live particles shared by all the systems of the process.
+ * Every ParticleSystem is registered when it is created. When the total particles of the systems is over the limit,
+ * update() gives the budget to the systems of higher priority first; in the priority which can not be satisfied,
+ * the rest is shared by the total particles of each system weighted by its distance, and the lower priorities get
+ * nothing. A system out of budget has its emission rate and total particles scaled down, the particles alive are
+ * not removed, so it fades out instead of popping.
+ *
+ * @code
+ * ParticleBudget::getInstance().setLimit(20000);
+ * ...
+ * ParticleBudget::getInstance().update();    // once a frame, before updating the systems
+ * @endcode
+ */
+class ParticleBudget
+{
+public:
+    static ParticleBudget& getInstance();
+
+    /** Sets the maximum of the live particles of all the systems, 0 (the default) means no limit. */
+    void setLimit(int limit);
+    int getLimit() const { return limit_; }
+    /** Sets how fast the weight of a system drops with its distance: a system at this distance gets half the share
+     * of one at distance 0.
+     */
+    void setFalloffDistance(float distance) { falloff_distance_ = distance; }
+    float getFalloffDistance() const { return falloff_distance_; }
+
+    /** Assigns the quotas of the systems. It should be called by the thread drawing the systems. */
+    void update();
+
+    /** Gets the particles alive in all the systems at the last update(). */
+    int getSpend() const { return spend_; }
+    /** Gets the total particles requested by all the systems at the last update(). */
+    int getDemand() const { return demand_; }
+    /** Gets the total particles assigned to all the systems at the last update(). */
+    int getAssigned() const { return assigned_; }
+    int getSystemCount() const;
+
+private:
+    friend class ParticleSystem;
+    ParticleBudget() {}
+    void add(ParticleSystem* system);
+    void remove(ParticleSystem* system);
+
+    mutable std::mutex mutex_;
+    std::vector<ParticleSystem*> systems_;
+    int limit_ = 0;
+    float falloff_distance_ = 1000;
+    int spend_ = 0, demand_ = 0, assigned_ = 0;
+    //quota and weight of each system in update()
+    std::vector<float> quotas_, weights_;
+    std::vector<int> order_;
+};
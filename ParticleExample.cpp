@@ -21,6 +21,9 @@ void ParticleExample::setStyle(PatticleStyle style)
     {
         initWithTotalParticles(250);
 
+        // additive
+        this->setBlendAdditive(true);
+
         // duration
         _duration = DURATION_INFINITY;
 
@@ -79,6 +82,9 @@ void ParticleExample::setStyle(PatticleStyle style)
     {
         initWithTotalParticles(1500);
 
+        // additive
+        this->setBlendAdditive(false);
+
         // duration
         _duration = DURATION_INFINITY;
 
@@ -138,7 +144,7 @@ void ParticleExample::setStyle(PatticleStyle style)
         initWithTotalParticles(350);
 
         // additive
-        //this->setBlendAdditive(true);
+        this->setBlendAdditive(true);
 
         // duration
         _duration = DURATION_INFINITY;
@@ -197,6 +203,10 @@ void ParticleExample::setStyle(PatticleStyle style)
     case ParticleExample::GALAXY:
     {
         initWithTotalParticles(200);
+
+        // additive
+        this->setBlendAdditive(true);
+
         // duration
         _duration = DURATION_INFINITY;
 
@@ -259,6 +269,9 @@ void ParticleExample::setStyle(PatticleStyle style)
     {
         initWithTotalParticles(250);
 
+        // additive
+        this->setBlendAdditive(true);
+
         // duration
         _duration = DURATION_INFINITY;
 
@@ -321,6 +334,9 @@ void ParticleExample::setStyle(PatticleStyle style)
     {
         initWithTotalParticles(150);
 
+        // additive
+        this->setBlendAdditive(true);
+
         // duration
         _duration = DURATION_INFINITY;
 
@@ -383,6 +399,9 @@ void ParticleExample::setStyle(PatticleStyle style)
     {
         initWithTotalParticles(500);
 
+        // additive
+        this->setBlendAdditive(false);
+
         // duration
         _duration = DURATION_INFINITY;
 
@@ -445,6 +464,9 @@ void ParticleExample::setStyle(PatticleStyle style)
     {
         initWithTotalParticles(700);
 
+        // additive
+        this->setBlendAdditive(false);
+
         // duration
         _duration = 0.1f;
 
@@ -506,6 +528,9 @@ void ParticleExample::setStyle(PatticleStyle style)
     {
         initWithTotalParticles(200);
 
+        // additive
+        this->setBlendAdditive(false);
+
         // duration
         _duration = DURATION_INFINITY;
 
@@ -564,6 +589,9 @@ void ParticleExample::setStyle(PatticleStyle style)
     {
         initWithTotalParticles(700);
 
+        // additive
+        this->setBlendAdditive(false);
+
         // duration
         _duration = DURATION_INFINITY;
 
@@ -626,6 +654,9 @@ void ParticleExample::setStyle(PatticleStyle style)
     {
         initWithTotalParticles(1000);
 
+        // additive
+        this->setBlendAdditive(false);
+
         // duration
         _duration = DURATION_INFINITY;
 
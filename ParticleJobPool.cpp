@@ -0,0 +1,211 @@
+#include "ParticleJobPool.h"
+#include <algorithm>
+
+ParticleJobPool::ParticleJobPool(int threads)
+{
+    int count = threads > 0 ? threads : (std::max)(1, SDL_GetCPUCount());
+    queues_.reset(new Queue[count]);
+    for (int i = 1; i < count; i++)
+    {
+        threads_.emplace_back([this, i]() { work(i); });
+    }
+}
+
+ParticleJobPool::~ParticleJobPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : threads_)
+    {
+        t.join();
+    }
+}
+
+void ParticleJobPool::setChunkSize(int size)
+{
+    //a chunk is made of whole blocks, so the kernels see the same ranges as in the fused update
+    chunk_size_ = ((std::max)(1, size) + ParticleSystem::FUSED_BLOCK - 1) / ParticleSystem::FUSED_BLOCK * ParticleSystem::FUSED_BLOCK;
+}
+
+void ParticleJobPool::work(int worker)
+{
+    unsigned generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this, generation]() { return quit_ || generation_ != generation; });
+            if (quit_)
+            {
+                return;
+            }
+            generation = generation_;
+        }
+        while (runTask(worker))
+        {
+        }
+    }
+}
+
+bool ParticleJobPool::runTask(int worker)
+{
+    int count = getThreadCount();
+    int task = -1;
+    for (int k = 0; k < count && task < 0; k++)
+    {
+        auto& queue = queues_[(worker + k) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+        {
+            continue;
+        }
+        if (k == 0)
+        {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+    }
+    if (task < 0)
+    {
+        return false;
+    }
+    (*job_)(task);
+    if (--remaining_ == 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.notify_all();
+    }
+    return true;
+}
+
+void ParticleJobPool::parallelFor(int count, const std::function<void(int)>& job)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    if (threads_.empty() || count == 1)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            job(i);
+        }
+        return;
+    }
+    int threads = getThreadCount();
+    job_ = &job;
+    remaining_ = count;
+    //each thread starts with a contiguous range, the last task of it is taken first
+    for (int w = 0; w < threads; w++)
+    {
+        std::lock_guard<std::mutex> lock(queues_[w].mutex);
+        for (int i = count * w / threads; i < count * (w + 1) / threads; i++)
+        {
+            queues_[w].tasks.push_back(count - 1 - i);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_++;
+    }
+    wake_.notify_all();
+    while (runTask(0))
+    {
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return remaining_ == 0; });
+    job_ = nullptr;
+}
+
+void ParticleJobPool::update(ParticleSystem* const* systems, int count, float dt)
+{
+    steps_.assign(count, 0);
+    step_dts_.assign(count, 0);
+    int max_steps = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (!systems[i]->isSimulationThreadRunning())
+        {
+            steps_[i] = systems[i]->prepareSteps(dt, step_dts_[i]);
+            max_steps = (std::max)(max_steps, steps_[i]);
+        }
+    }
+
+    for (int k = 0; k < max_steps; k++)
+    {
+        emitting_.clear();
+        for (int i = 0; i < count; i++)
+        {
+            if (steps_[i] > k)
+            {
+                emitting_.push_back(i);
+            }
+        }
+        parallelFor(int(emitting_.size()), [this, systems](int j)
+            {
+                systems[emitting_[j]]->emit(step_dts_[emitting_[j]]);
+            });
+
+        chunks_.clear();
+        first_chunks_.clear();
+        for (int i : emitting_)
+        {
+            auto s = systems[i];
+            float step = step_dts_[i];
+            first_chunks_.push_back(int(chunks_.size()));
+            if (s->getUpdatePath() == ParticleSystem::UpdatePath::MULTI_PASS)
+            {
+                chunks_.push_back({ s, -1, -1, step, ParticleBounds() });
+                continue;
+            }
+            int particles = int(s->getParticleCount());
+            for (int begin = 0; begin < particles; begin += chunk_size_)
+            {
+                chunks_.push_back({ s, begin, (std::min)(begin + chunk_size_, particles), step, ParticleBounds() });
+            }
+            if (particles == 0)
+            {
+                chunks_.push_back({ s, 0, 0, step, ParticleBounds() });
+            }
+        }
+        first_chunks_.push_back(int(chunks_.size()));
+
+        parallelFor(int(chunks_.size()), [this](int c)
+            {
+                auto& chunk = chunks_[c];
+                if (chunk.begin < 0)
+                {
+                    chunk.system->updateMultiPass(chunk.dt, chunk.bounds);
+                }
+                else
+                {
+                    chunk.system->integrate(chunk.begin, chunk.end, chunk.dt, chunk.bounds);
+                }
+            });
+        parallelFor(int(first_chunks_.size()) - 1, [this](int j)
+            {
+                auto& first = chunks_[first_chunks_[j]];
+                ParticleBounds bounds;
+                for (int c = first_chunks_[j]; c < first_chunks_[j + 1]; c++)
+                {
+                    bounds.merge(chunks_[c].bounds);
+                }
+                if (first.begin < 0)
+                {
+                    first.system->finishStep(bounds);
+                }
+                else
+                {
+                    first.system->compact(bounds);
+                }
+            });
+    }
+}
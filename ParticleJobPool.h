@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ParticleSystem.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/** A pool of threads to update many systems at once.
+ * A job is split into tasks which are dealt out to the queues of the threads; a thread takes the tasks of its own
+ * queue from the back, and when it is empty steals from the front of the others, so a few big systems do not leave
+ * the other threads idle. The thread calling the pool works as the first thread.
+ *
+ * update() splits each step of the systems into phases: each system emits in one task; the particles are integrated
+ * in chunks, a big system is shared by several threads; then each system is compacted by one task. The spawned
+ * particles depend only on the seed of each system, so the result does not depend on the number of threads or the
+ * chunk size, and is the same as update() of each system with the fused update path.
+ *
+ * @code
+ * ParticleJobPool pool;
+ * ...
+ * pool.update(systems.data(), int(systems.size()), dt);
+ * @endcode
+ */
+class ParticleJobPool
+{
+public:
+    /** @param threads The number of threads including the calling one, 0 for the number of CPUs. */
+    ParticleJobPool(int threads = 0);
+    ~ParticleJobPool();
+    ParticleJobPool(const ParticleJobPool&) = delete;
+    ParticleJobPool& operator=(const ParticleJobPool&) = delete;
+
+    int getThreadCount() const { return int(threads_.size()) + 1; }
+    /** Sets the particles in a chunk of update(), rounded up to a multiple of 256 (the block of the fused update). */
+    void setChunkSize(int size);
+    int getChunkSize() const { return chunk_size_; }
+
+    /** Runs job(0) ... job(count - 1) on the threads of the pool and waits for them.
+     * It must not be called from a job, or from two threads at once.
+     */
+    void parallelFor(int count, const std::function<void(int)>& job);
+
+    /** Updates the systems like update(dt) of each one.
+     * The systems must not be shared in the array, and those running their own simulation thread are skipped.
+     */
+    void update(ParticleSystem* const* systems, int count, float dt);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+    struct Chunk
+    {
+        ParticleSystem* system;
+        int begin, end;    //begin < 0 for a system with the multi-pass update, which is not split
+        float dt;
+        ParticleBounds bounds;
+    };
+    void work(int worker);
+    bool runTask(int worker);
+
+    std::vector<std::thread> threads_;
+    std::unique_ptr<Queue[]> queues_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    const std::function<void(int)>* job_ = nullptr;
+    std::atomic<int> remaining_{ 0 };
+    unsigned generation_ = 0;
+    bool quit_ = false;
+    int chunk_size_ = 4096;
+
+    //scratch of update()
+    std::vector<Chunk> chunks_;
+    std::vector<int> steps_, first_chunks_, emitting_;
+    std::vector<float> step_dts_;
+};
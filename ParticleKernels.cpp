@@ -0,0 +1,1331 @@
+#include "ParticleKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__)) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PARTICLE_SIMD_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PARTICLE_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+//the AVX2 versions are compiled for AVX2 only, the dispatcher makes sure they are called on a CPU supporting it
+#if defined(__GNUC__) || defined(__clang__)
+#define PARTICLE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PARTICLE_TARGET_AVX2
+#endif
+
+namespace ParticleKernels
+{
+
+using TrigPrecision = ParticleSystem::TrigPrecision;
+
+//sin/cos: x = k * pi/2 + r, |r| <= pi/4, then minimax polynomials of r
+static const float TWO_OVER_PI = 0.636619772f;
+static const float PIO2_1 = 1.5703125f;
+static const float PIO2_2 = 4.837512969970703125e-4f;
+static const float PIO2_3 = 7.54978995489188216e-8f;
+
+static const float SIN_1 = -1.6666654611e-1f;
+static const float SIN_2 = 8.3321608736e-3f;
+static const float SIN_3 = -1.9515295891e-4f;
+static const float COS_1 = -0.5f;
+static const float COS_2 = 4.166664568298827e-2f;
+static const float COS_3 = -1.388731625493765e-3f;
+static const float COS_4 = 2.443315711809948e-5f;
+
+static const float FAST_SIN_1 = -0.1666283381f;
+static const float FAST_SIN_2 = 0.0081529923f;
+static const float FAST_COS_1 = -0.4997763071f;
+static const float FAST_COS_2 = 0.0404889359f;
+
+//scalar
+
+static inline void sinCosScalar(float x, float& s, float& c, bool fast)
+{
+    float kf = nearbyintf(x * TWO_OVER_PI);
+    int k = int(kf);
+    float r = ((x - kf * PIO2_1) - kf * PIO2_2) - kf * PIO2_3;
+    float z = r * r;
+    float sr, cr;
+    if (fast)
+    {
+        sr = r + r * z * (FAST_SIN_1 + z * FAST_SIN_2);
+        cr = 1.0f + z * (FAST_COS_1 + z * FAST_COS_2);
+    }
+    else
+    {
+        sr = r + r * z * (SIN_1 + z * (SIN_2 + z * SIN_3));
+        cr = 1.0f + z * (COS_1 + z * (COS_2 + z * (COS_3 + z * COS_4)));
+    }
+    if (k & 1)
+    {
+        std::swap(sr, cr);
+    }
+    s = (k & 2) ? -sr : sr;
+    c = ((k + 1) & 2) ? -cr : cr;
+}
+
+static void sinCosScalar(const float* x, float* s, float* c, int n, TrigPrecision precision)
+{
+    if (precision == TrigPrecision::LIBM)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            s[i] = sinf(x[i]);
+            c[i] = cosf(x[i]);
+        }
+        return;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        sinCosScalar(x[i], s[i], c[i], precision == TrigPrecision::FAST);
+    }
+}
+
+//the update kernels are specialized for the features of the particles, see Feature, a part which is zero for all of
+//them is not computed at all
+template <bool DELTA_RADIUS>
+static void updateRadiusScalar(ParticleData& p, int begin, int end, float dt, float yFlip, TrigPrecision precision)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        p.modeB.angle[i] += p.modeB.degreesPerSecond[i] * dt;
+        if constexpr (DELTA_RADIUS)
+        {
+            p.modeB.radius[i] += p.modeB.deltaRadius[i] * dt;
+        }
+        float s, c;
+        if (precision == TrigPrecision::LIBM)
+        {
+            s = sinf(p.modeB.angle[i]);
+            c = cosf(p.modeB.angle[i]);
+        }
+        else
+        {
+            sinCosScalar(p.modeB.angle[i], s, c, precision == TrigPrecision::FAST);
+        }
+        p.posx[i] = -c * p.modeB.radius[i];
+        p.posy[i] = -s * p.modeB.radius[i] * yFlip;
+    }
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+#define PARTICLE_QUAD_KERNELS
+
+static const float DEG_TO_RAD = 0.01745329252f;
+
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+static const int R_SHIFT = 24, G_SHIFT = 16, B_SHIFT = 8, A_SHIFT = 0;
+#else
+static const int R_SHIFT = 0, G_SHIFT = 8, B_SHIFT = 16, A_SHIFT = 24;
+#endif
+
+//corners of a quad computed in lanes, in the order of SDL_RenderCopyEx: top left, top right, bottom right, bottom left
+struct QuadLanes
+{
+    alignas(32) float x[4][8];
+    alignas(32) float y[4][8];
+    alignas(32) Uint32 color[8];
+};
+
+static inline void storeQuads(const QuadLanes& q, int lanes, const unsigned int* frame, const SDL_FRect* texCoords, SDL_Vertex* out)
+{
+    static const SDL_FRect whole = { 0, 0, 1, 1 };
+    for (int l = 0; l < lanes; l++)
+    {
+        SDL_Color color;
+        memcpy(&color, &q.color[l], sizeof(color));
+        const SDL_FRect& t = texCoords ? texCoords[frame[l]] : whole;
+        const SDL_FPoint uv[4] = { { t.x, t.y }, { t.x + t.w, t.y }, { t.x + t.w, t.y + t.h }, { t.x, t.y + t.h } };
+        for (int k = 0; k < 4; k++)
+        {
+            out->position.x = q.x[k][l];
+            out->position.y = q.y[k][l];
+            out->color = color;
+            out->tex_coord = uv[k];
+            out++;
+        }
+    }
+}
+
+static inline Uint32 packColorScalar(float r, float g, float b, float a)
+{
+    auto u8 = [](float v) { return Uint32((std::min)((std::max)(v * 255.0f, 0.0f), 255.0f)); };
+    return (u8(r) << R_SHIFT) | (u8(g) << G_SHIFT) | (u8(b) << B_SHIFT) | (u8(a) << A_SHIFT);
+}
+
+static void buildQuadVerticesScalar(const ParticleDrawData& d, int begin, const SDL_FRect* texCoords, SDL_Vertex* out)
+{
+    QuadLanes q;
+    for (int i = begin; i < d.count; i += 8)
+    {
+        int lanes = (std::min)(8, d.count - i);
+        for (int l = 0; l < lanes; l++)
+        {
+            int j = i + l;
+            float s, c;
+            sinCosScalar(d.rotation[j] * DEG_TO_RAD, s, c, false);
+            float hc = 0.5f * c * d.size[j], hs = 0.5f * s * d.size[j];
+            q.x[0][l] = d.x[j] - hc + hs;
+            q.y[0][l] = d.y[j] - hs - hc;
+            q.x[1][l] = d.x[j] + hc + hs;
+            q.y[1][l] = d.y[j] + hs - hc;
+            q.x[2][l] = d.x[j] + hc - hs;
+            q.y[2][l] = d.y[j] + hs + hc;
+            q.x[3][l] = d.x[j] - hc - hs;
+            q.y[3][l] = d.y[j] - hs + hc;
+            q.color[l] = packColorScalar(d.r[j], d.g[j], d.b[j], d.a[j]);
+        }
+        storeQuads(q, lanes, &d.frame[i], texCoords, out + i * 4);
+    }
+}
+
+static void buildQuadVerticesScalar(const ParticleDrawData& d, const SDL_FRect* texCoords, SDL_Vertex* out)
+{
+    buildQuadVerticesScalar(d, 0, texCoords, out);
+}
+#endif
+
+//software rasterizer
+
+static const Uint8 WHITE_TEXEL[4] = { 255, 255, 255, 255 };
+
+static inline const Uint8* fetchTexel(const ParticleSoftwareQuad& q, float u, float v)
+{
+    if (q.texels == nullptr)
+    {
+        return WHITE_TEXEL;
+    }
+    int tx = (std::min)(int(u * q.frameW), q.frameW - 1);
+    int ty = (std::min)(int(v * q.frameH), q.frameH - 1);
+    return q.texels + ty * q.texPitch + tx * 4;
+}
+
+static inline void clipQuad(const ParticleSoftwareQuad& q, const SDL_Rect& clip, int& x0, int& y0, int& x1, int& y1)
+{
+    x0 = (std::max)(q.x0, clip.x);
+    y0 = (std::max)(q.y0, clip.y);
+    x1 = (std::min)(q.x1, clip.x + clip.w);
+    y1 = (std::min)(q.y1, clip.y + clip.h);
+}
+
+static void rasterizeQuadScalar(const ParticleSoftwareQuad& q, Uint8* pixels, int pitch, const SDL_Rect& clip)
+{
+    int x0, y0, x1, y1;
+    clipQuad(q, clip, x0, y0, x1, y1);
+    const float color[4] = { q.r, q.g, q.b, q.a };
+    for (int y = y0; y < y1; y++)
+    {
+        float dy = y + 0.5f - q.y;
+        Uint8* dst = pixels + y * pitch + x0 * 4;
+        for (int x = x0; x < x1; x++, dst += 4)
+        {
+            float dx = x + 0.5f - q.x;
+            float u = dx * q.ux + dy * q.uy + 0.5f;
+            float v = dy * q.ux - dx * q.uy + 0.5f;
+            if (!(u >= 0 && u < 1 && v >= 0 && v < 1))
+            {
+                continue;
+            }
+            const Uint8* texel = fetchTexel(q, u, v);
+            float a = texel[3] * q.a * (1.0f / 255);
+            if (q.additive)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    dst[k] = Uint8((std::min)(dst[k] + texel[k] * color[k] * a, 255.0f) + 0.5f);
+                }
+            }
+            else
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    dst[k] = Uint8(texel[k] * color[k] * a + dst[k] * (1 - a) + 0.5f);
+                }
+                dst[3] = Uint8(a * 255 + dst[3] * (1 - a) + 0.5f);
+            }
+        }
+    }
+}
+
+//half of the diagonal of a square of size 1
+static const float HALF_DIAGONAL = 0.7071068f;
+
+static void accumulateBoundsScalar(const ParticleData& p, int begin, int end, ParticleBounds& b)
+{
+    for (int i = begin; i < end; i++)
+    {
+        float x = p.posx[i] + p.startPosX[i];
+        float y = p.posy[i] + p.startPosY[i];
+        float e = p.size[i] * HALF_DIAGONAL;
+        b.minX = (std::min)(b.minX, x - e);
+        b.minY = (std::min)(b.minY, y - e);
+        b.maxX = (std::max)(b.maxX, x + e);
+        b.maxY = (std::max)(b.maxY, y + e);
+    }
+}
+
+template <bool ACCELERATION, bool GRAVITY>
+static void updateGravityScalar(ParticleData& p, int begin, int end, float dt, const Vec2& gravity, float yFlip)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        float x = p.posx[i], y = p.posy[i];
+
+        if constexpr (ACCELERATION || GRAVITY)
+        {
+            float ax = 0, ay = 0;
+            if constexpr (ACCELERATION)
+            {
+                // radial direction, zero when too close to the source
+                float rx = 0, ry = 0;
+                float n = sqrtf(x * x + y * y);
+                if (n >= 1e-5f)
+                {
+                    n = 1.0f / n;
+                    rx = x * n;
+                    ry = y * n;
+                }
+
+                // radial + tangential, the tangential direction is the radial one rotated by 90 degrees
+                ax = rx * p.modeA.radialAccel[i] + ry * -p.modeA.tangentialAccel[i];
+                ay = ry * p.modeA.radialAccel[i] + rx * p.modeA.tangentialAccel[i];
+            }
+            if constexpr (GRAVITY)
+            {
+                ax += gravity.x;
+                ay += gravity.y;
+            }
+            p.modeA.dirX[i] += ax * dt;
+            p.modeA.dirY[i] += ay * dt;
+        }
+
+        p.posx[i] += p.modeA.dirX[i] * dt * yFlip;
+        p.posy[i] += p.modeA.dirY[i] * dt * yFlip;
+    }
+}
+
+static void spawnRandomScalar(float* out, int n, Uint32 key, Uint32 serial, float base, float var, float scale, float lo, float hi)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        float v = (base + var * random11(key, serial + Uint32(i))) * scale;
+        out[i] = (std::min)((std::max)(v, lo), hi);
+    }
+}
+
+#ifdef PARTICLE_SIMD_X86
+
+template <bool ACCELERATION, bool GRAVITY>
+static void updateGravitySSE2(ParticleData& p, int begin, int end, float dt, const Vec2& gravity, float yFlip)
+{
+    const __m128 vdt = _mm_set1_ps(dt);
+    const __m128 vflip = _mm_set1_ps(yFlip);
+    const __m128 gx = _mm_set1_ps(gravity.x);
+    const __m128 gy = _mm_set1_ps(gravity.y);
+    const __m128 eps = _mm_set1_ps(1e-5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(p.posx + i);
+        __m128 y = _mm_loadu_ps(p.posy + i);
+        __m128 dx = _mm_loadu_ps(p.modeA.dirX + i);
+        __m128 dy = _mm_loadu_ps(p.modeA.dirY + i);
+        if constexpr (ACCELERATION || GRAVITY)
+        {
+            __m128 ax = _mm_setzero_ps(), ay = _mm_setzero_ps();
+            if constexpr (ACCELERATION)
+            {
+                __m128 n = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+                __m128 inv = _mm_and_ps(_mm_cmpge_ps(n, eps), _mm_div_ps(one, n));
+                __m128 rx = _mm_mul_ps(x, inv);
+                __m128 ry = _mm_mul_ps(y, inv);
+
+                __m128 radial = _mm_loadu_ps(p.modeA.radialAccel + i);
+                __m128 tangential = _mm_loadu_ps(p.modeA.tangentialAccel + i);
+                ax = _mm_add_ps(_mm_mul_ps(rx, radial), _mm_mul_ps(ry, _mm_xor_ps(tangential, sign)));
+                ay = _mm_add_ps(_mm_mul_ps(ry, radial), _mm_mul_ps(rx, tangential));
+            }
+            if constexpr (GRAVITY)
+            {
+                ax = _mm_add_ps(ax, gx);
+                ay = _mm_add_ps(ay, gy);
+            }
+            dx = _mm_add_ps(dx, _mm_mul_ps(ax, vdt));
+            dy = _mm_add_ps(dy, _mm_mul_ps(ay, vdt));
+            _mm_storeu_ps(p.modeA.dirX + i, dx);
+            _mm_storeu_ps(p.modeA.dirY + i, dy);
+        }
+
+        _mm_storeu_ps(p.posx + i, _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(dx, vdt), vflip)));
+        _mm_storeu_ps(p.posy + i, _mm_add_ps(y, _mm_mul_ps(_mm_mul_ps(dy, vdt), vflip)));
+    }
+    updateGravityScalar<ACCELERATION, GRAVITY>(p, i, end, dt, gravity, yFlip);
+}
+
+template <bool ACCELERATION, bool GRAVITY>
+PARTICLE_TARGET_AVX2 static void updateGravityAVX2(ParticleData& p, int begin, int end, float dt, const Vec2& gravity, float yFlip)
+{
+    const __m256 vdt = _mm256_set1_ps(dt);
+    const __m256 vflip = _mm256_set1_ps(yFlip);
+    const __m256 gx = _mm256_set1_ps(gravity.x);
+    const __m256 gy = _mm256_set1_ps(gravity.y);
+    const __m256 eps = _mm256_set1_ps(1e-5f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(p.posx + i);
+        __m256 y = _mm256_loadu_ps(p.posy + i);
+        __m256 dx = _mm256_loadu_ps(p.modeA.dirX + i);
+        __m256 dy = _mm256_loadu_ps(p.modeA.dirY + i);
+        if constexpr (ACCELERATION || GRAVITY)
+        {
+            __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps();
+            if constexpr (ACCELERATION)
+            {
+                __m256 n = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)));
+                __m256 inv = _mm256_and_ps(_mm256_cmp_ps(n, eps, _CMP_GE_OQ), _mm256_div_ps(one, n));
+                __m256 rx = _mm256_mul_ps(x, inv);
+                __m256 ry = _mm256_mul_ps(y, inv);
+
+                __m256 radial = _mm256_loadu_ps(p.modeA.radialAccel + i);
+                __m256 tangential = _mm256_loadu_ps(p.modeA.tangentialAccel + i);
+                ax = _mm256_add_ps(_mm256_mul_ps(rx, radial), _mm256_mul_ps(ry, _mm256_xor_ps(tangential, sign)));
+                ay = _mm256_add_ps(_mm256_mul_ps(ry, radial), _mm256_mul_ps(rx, tangential));
+            }
+            if constexpr (GRAVITY)
+            {
+                ax = _mm256_add_ps(ax, gx);
+                ay = _mm256_add_ps(ay, gy);
+            }
+            dx = _mm256_add_ps(dx, _mm256_mul_ps(ax, vdt));
+            dy = _mm256_add_ps(dy, _mm256_mul_ps(ay, vdt));
+            _mm256_storeu_ps(p.modeA.dirX + i, dx);
+            _mm256_storeu_ps(p.modeA.dirY + i, dy);
+        }
+
+        _mm256_storeu_ps(p.posx + i, _mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(dx, vdt), vflip)));
+        _mm256_storeu_ps(p.posy + i, _mm256_add_ps(y, _mm256_mul_ps(_mm256_mul_ps(dy, vdt), vflip)));
+    }
+    updateGravitySSE2<ACCELERATION, GRAVITY>(p, i, end, dt, gravity, yFlip);
+}
+
+static inline float horizontalMinSSE2(__m128 v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float horizontalMaxSSE2(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static void accumulateBoundsSSE2(const ParticleData& p, int begin, int end, ParticleBounds& b)
+{
+    const __m128 diagonal = _mm_set1_ps(HALF_DIAGONAL);
+    __m128 min_x = _mm_set1_ps(b.minX), min_y = _mm_set1_ps(b.minY);
+    __m128 max_x = _mm_set1_ps(b.maxX), max_y = _mm_set1_ps(b.maxY);
+    int i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_add_ps(_mm_loadu_ps(p.posx + i), _mm_loadu_ps(p.startPosX + i));
+        __m128 y = _mm_add_ps(_mm_loadu_ps(p.posy + i), _mm_loadu_ps(p.startPosY + i));
+        __m128 e = _mm_mul_ps(_mm_loadu_ps(p.size + i), diagonal);
+        min_x = _mm_min_ps(min_x, _mm_sub_ps(x, e));
+        min_y = _mm_min_ps(min_y, _mm_sub_ps(y, e));
+        max_x = _mm_max_ps(max_x, _mm_add_ps(x, e));
+        max_y = _mm_max_ps(max_y, _mm_add_ps(y, e));
+    }
+    b.minX = horizontalMinSSE2(min_x);
+    b.minY = horizontalMinSSE2(min_y);
+    b.maxX = horizontalMaxSSE2(max_x);
+    b.maxY = horizontalMaxSSE2(max_y);
+    accumulateBoundsScalar(p, i, end, b);
+}
+
+PARTICLE_TARGET_AVX2 static void accumulateBoundsAVX2(const ParticleData& p, int begin, int end, ParticleBounds& b)
+{
+    const __m256 diagonal = _mm256_set1_ps(HALF_DIAGONAL);
+    __m256 min_x = _mm256_set1_ps(b.minX), min_y = _mm256_set1_ps(b.minY);
+    __m256 max_x = _mm256_set1_ps(b.maxX), max_y = _mm256_set1_ps(b.maxY);
+    int i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 x = _mm256_add_ps(_mm256_loadu_ps(p.posx + i), _mm256_loadu_ps(p.startPosX + i));
+        __m256 y = _mm256_add_ps(_mm256_loadu_ps(p.posy + i), _mm256_loadu_ps(p.startPosY + i));
+        __m256 e = _mm256_mul_ps(_mm256_loadu_ps(p.size + i), diagonal);
+        min_x = _mm256_min_ps(min_x, _mm256_sub_ps(x, e));
+        min_y = _mm256_min_ps(min_y, _mm256_sub_ps(y, e));
+        max_x = _mm256_max_ps(max_x, _mm256_add_ps(x, e));
+        max_y = _mm256_max_ps(max_y, _mm256_add_ps(y, e));
+    }
+    b.minX = horizontalMinSSE2(_mm_min_ps(_mm256_castps256_ps128(min_x), _mm256_extractf128_ps(min_x, 1)));
+    b.minY = horizontalMinSSE2(_mm_min_ps(_mm256_castps256_ps128(min_y), _mm256_extractf128_ps(min_y, 1)));
+    b.maxX = horizontalMaxSSE2(_mm_max_ps(_mm256_castps256_ps128(max_x), _mm256_extractf128_ps(max_x, 1)));
+    b.maxY = horizontalMaxSSE2(_mm_max_ps(_mm256_castps256_ps128(max_y), _mm256_extractf128_ps(max_y, 1)));
+    accumulateBoundsScalar(p, i, end, b);
+}
+
+//SSE2 has no 32 bit multiply, the even and the odd lanes are multiplied to 64 bits
+static inline __m128i mulloSSE2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128 random11SSE2(__m128i key, __m128i serial)
+{
+    __m128i x = _mm_xor_si128(serial, key);
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = mulloSSE2(x, _mm_set1_epi32(int(HASH_1)));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = mulloSSE2(x, _mm_set1_epi32(int(HASH_2)));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = _mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x40000000));
+    return _mm_sub_ps(_mm_castsi128_ps(x), _mm_set1_ps(3.0f));
+}
+
+static void spawnRandomSSE2(float* out, int n, Uint32 key, Uint32 serial, float base, float var, float scale, float lo, float hi)
+{
+    const __m128i vkey = _mm_set1_epi32(int(key));
+    const __m128 vbase = _mm_set1_ps(base);
+    const __m128 vvar = _mm_set1_ps(var);
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vlo = _mm_set1_ps(lo);
+    const __m128 vhi = _mm_set1_ps(hi);
+    __m128i vserial = _mm_add_epi32(_mm_set1_epi32(int(serial)), _mm_setr_epi32(0, 1, 2, 3));
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_mul_ps(_mm_add_ps(vbase, _mm_mul_ps(vvar, random11SSE2(vkey, vserial))), vscale);
+        //the bound is the first operand, so a signed zero is kept like std::max/std::min
+        _mm_storeu_ps(out + i, _mm_min_ps(vhi, _mm_max_ps(vlo, v)));
+        vserial = _mm_add_epi32(vserial, _mm_set1_epi32(4));
+    }
+    spawnRandomScalar(out + i, n - i, key, serial + Uint32(i), base, var, scale, lo, hi);
+}
+
+PARTICLE_TARGET_AVX2 static void spawnRandomAVX2(float* out, int n, Uint32 key, Uint32 serial, float base, float var, float scale, float lo, float hi)
+{
+    const __m256i vkey = _mm256_set1_epi32(int(key));
+    const __m256i hash1 = _mm256_set1_epi32(int(HASH_1));
+    const __m256i hash2 = _mm256_set1_epi32(int(HASH_2));
+    const __m256i exponent = _mm256_set1_epi32(0x40000000);
+    const __m256 three = _mm256_set1_ps(3.0f);
+    const __m256 vbase = _mm256_set1_ps(base);
+    const __m256 vvar = _mm256_set1_ps(var);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 vlo = _mm256_set1_ps(lo);
+    const __m256 vhi = _mm256_set1_ps(hi);
+    __m256i vserial = _mm256_add_epi32(_mm256_set1_epi32(int(serial)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i x = _mm256_xor_si256(vserial, vkey);
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+        x = _mm256_mullo_epi32(x, hash1);
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+        x = _mm256_mullo_epi32(x, hash2);
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+        __m256 r = _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(x, 9), exponent)), three);
+        __m256 v = _mm256_mul_ps(_mm256_add_ps(vbase, _mm256_mul_ps(vvar, r)), vscale);
+        _mm256_storeu_ps(out + i, _mm256_min_ps(vhi, _mm256_max_ps(vlo, v)));
+        vserial = _mm256_add_epi32(vserial, _mm256_set1_epi32(8));
+    }
+    spawnRandomSSE2(out + i, n - i, key, serial + Uint32(i), base, var, scale, lo, hi);
+}
+
+static inline void sinCosSSE2(__m128 x, __m128& s, __m128& c, bool fast)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    __m128i k = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)));
+    __m128 kf = _mm_cvtepi32_ps(k);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(kf, _mm_set1_ps(PIO2_1)));
+    r = _mm_sub_ps(r, _mm_mul_ps(kf, _mm_set1_ps(PIO2_2)));
+    r = _mm_sub_ps(r, _mm_mul_ps(kf, _mm_set1_ps(PIO2_3)));
+    __m128 z = _mm_mul_ps(r, r);
+    __m128 sr, cr;
+    if (fast)
+    {
+        sr = _mm_add_ps(_mm_set1_ps(FAST_SIN_1), _mm_mul_ps(z, _mm_set1_ps(FAST_SIN_2)));
+        cr = _mm_add_ps(_mm_set1_ps(FAST_COS_1), _mm_mul_ps(z, _mm_set1_ps(FAST_COS_2)));
+    }
+    else
+    {
+        sr = _mm_add_ps(_mm_set1_ps(SIN_2), _mm_mul_ps(z, _mm_set1_ps(SIN_3)));
+        sr = _mm_add_ps(_mm_set1_ps(SIN_1), _mm_mul_ps(z, sr));
+        cr = _mm_add_ps(_mm_set1_ps(COS_3), _mm_mul_ps(z, _mm_set1_ps(COS_4)));
+        cr = _mm_add_ps(_mm_set1_ps(COS_2), _mm_mul_ps(z, cr));
+        cr = _mm_add_ps(_mm_set1_ps(COS_1), _mm_mul_ps(z, cr));
+    }
+    sr = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, z), sr));
+    cr = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(z, cr));
+
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(k, one), one));
+    __m128 s0 = _mm_or_ps(_mm_and_ps(swap, cr), _mm_andnot_ps(swap, sr));
+    __m128 c0 = _mm_or_ps(_mm_and_ps(swap, sr), _mm_andnot_ps(swap, cr));
+    s = _mm_xor_ps(s0, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(k, two), 30)));
+    c = _mm_xor_ps(c0, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(k, one), two), 30)));
+}
+
+static void sinCosSSE2(const float* x, float* s, float* c, int n, TrigPrecision precision)
+{
+    if (precision == TrigPrecision::LIBM)
+    {
+        sinCosScalar(x, s, c, n, precision);
+        return;
+    }
+    bool fast = precision == TrigPrecision::FAST;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 vs, vc;
+        sinCosSSE2(_mm_loadu_ps(x + i), vs, vc, fast);
+        _mm_storeu_ps(s + i, vs);
+        _mm_storeu_ps(c + i, vc);
+    }
+    sinCosScalar(x + i, s + i, c + i, n - i, precision);
+}
+
+template <bool DELTA_RADIUS>
+static void updateRadiusSSE2(ParticleData& p, int begin, int end, float dt, float yFlip, TrigPrecision precision)
+{
+    if (precision == TrigPrecision::LIBM)
+    {
+        updateRadiusScalar<DELTA_RADIUS>(p, begin, end, dt, yFlip, precision);
+        return;
+    }
+    bool fast = precision == TrigPrecision::FAST;
+    const __m128 vdt = _mm_set1_ps(dt);
+    const __m128 vflip = _mm_set1_ps(yFlip);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    int i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 angle = _mm_add_ps(_mm_loadu_ps(p.modeB.angle + i), _mm_mul_ps(_mm_loadu_ps(p.modeB.degreesPerSecond + i), vdt));
+        __m128 radius = _mm_loadu_ps(p.modeB.radius + i);
+        _mm_storeu_ps(p.modeB.angle + i, angle);
+        if constexpr (DELTA_RADIUS)
+        {
+            radius = _mm_add_ps(radius, _mm_mul_ps(_mm_loadu_ps(p.modeB.deltaRadius + i), vdt));
+            _mm_storeu_ps(p.modeB.radius + i, radius);
+        }
+        __m128 vs, vc;
+        sinCosSSE2(angle, vs, vc, fast);
+        _mm_storeu_ps(p.posx + i, _mm_mul_ps(_mm_xor_ps(vc, sign), radius));
+        _mm_storeu_ps(p.posy + i, _mm_mul_ps(_mm_mul_ps(_mm_xor_ps(vs, sign), radius), vflip));
+    }
+    updateRadiusScalar<DELTA_RADIUS>(p, i, end, dt, yFlip, precision);
+}
+
+PARTICLE_TARGET_AVX2 static inline void sinCosAVX2(__m256 x, __m256& s, __m256& c, bool fast)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    __m256i k = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)));
+    __m256 kf = _mm256_cvtepi32_ps(k);
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(kf, _mm256_set1_ps(PIO2_1)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(kf, _mm256_set1_ps(PIO2_2)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(kf, _mm256_set1_ps(PIO2_3)));
+    __m256 z = _mm256_mul_ps(r, r);
+    __m256 sr, cr;
+    if (fast)
+    {
+        sr = _mm256_add_ps(_mm256_set1_ps(FAST_SIN_1), _mm256_mul_ps(z, _mm256_set1_ps(FAST_SIN_2)));
+        cr = _mm256_add_ps(_mm256_set1_ps(FAST_COS_1), _mm256_mul_ps(z, _mm256_set1_ps(FAST_COS_2)));
+    }
+    else
+    {
+        sr = _mm256_add_ps(_mm256_set1_ps(SIN_2), _mm256_mul_ps(z, _mm256_set1_ps(SIN_3)));
+        sr = _mm256_add_ps(_mm256_set1_ps(SIN_1), _mm256_mul_ps(z, sr));
+        cr = _mm256_add_ps(_mm256_set1_ps(COS_3), _mm256_mul_ps(z, _mm256_set1_ps(COS_4)));
+        cr = _mm256_add_ps(_mm256_set1_ps(COS_2), _mm256_mul_ps(z, cr));
+        cr = _mm256_add_ps(_mm256_set1_ps(COS_1), _mm256_mul_ps(z, cr));
+    }
+    sr = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, z), sr));
+    cr = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(z, cr));
+
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(k, one), one));
+    __m256 s0 = _mm256_blendv_ps(sr, cr, swap);
+    __m256 c0 = _mm256_blendv_ps(cr, sr, swap);
+    s = _mm256_xor_ps(s0, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(k, two), 30)));
+    c = _mm256_xor_ps(c0, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(k, one), two), 30)));
+}
+
+PARTICLE_TARGET_AVX2 static void sinCosAVX2(const float* x, float* s, float* c, int n, TrigPrecision precision)
+{
+    if (precision == TrigPrecision::LIBM)
+    {
+        sinCosScalar(x, s, c, n, precision);
+        return;
+    }
+    bool fast = precision == TrigPrecision::FAST;
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 vs, vc;
+        sinCosAVX2(_mm256_loadu_ps(x + i), vs, vc, fast);
+        _mm256_storeu_ps(s + i, vs);
+        _mm256_storeu_ps(c + i, vc);
+    }
+    sinCosSSE2(x + i, s + i, c + i, n - i, precision);
+}
+
+template <bool DELTA_RADIUS>
+PARTICLE_TARGET_AVX2 static void updateRadiusAVX2(ParticleData& p, int begin, int end, float dt, float yFlip, TrigPrecision precision)
+{
+    if (precision == TrigPrecision::LIBM)
+    {
+        updateRadiusScalar<DELTA_RADIUS>(p, begin, end, dt, yFlip, precision);
+        return;
+    }
+    bool fast = precision == TrigPrecision::FAST;
+    const __m256 vdt = _mm256_set1_ps(dt);
+    const __m256 vflip = _mm256_set1_ps(yFlip);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    int i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 angle = _mm256_add_ps(_mm256_loadu_ps(p.modeB.angle + i), _mm256_mul_ps(_mm256_loadu_ps(p.modeB.degreesPerSecond + i), vdt));
+        __m256 radius = _mm256_loadu_ps(p.modeB.radius + i);
+        _mm256_storeu_ps(p.modeB.angle + i, angle);
+        if constexpr (DELTA_RADIUS)
+        {
+            radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_loadu_ps(p.modeB.deltaRadius + i), vdt));
+            _mm256_storeu_ps(p.modeB.radius + i, radius);
+        }
+        __m256 vs, vc;
+        sinCosAVX2(angle, vs, vc, fast);
+        _mm256_storeu_ps(p.posx + i, _mm256_mul_ps(_mm256_xor_ps(vc, sign), radius));
+        _mm256_storeu_ps(p.posy + i, _mm256_mul_ps(_mm256_mul_ps(_mm256_xor_ps(vs, sign), radius), vflip));
+    }
+    updateRadiusSSE2<DELTA_RADIUS>(p, i, end, dt, yFlip, precision);
+}
+
+#ifdef PARTICLE_QUAD_KERNELS
+static void buildQuadVerticesSSE2(const ParticleDrawData& d, const SDL_FRect* texCoords, SDL_Vertex* out)
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 zero = _mm_setzero_ps();
+    auto u8 = [&](const std::vector<float>& v, int i, int shift)
+    {
+        __m128 f = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&v[i]), scale), zero), scale);
+        return _mm_slli_epi32(_mm_cvttps_epi32(f), shift);
+    };
+    QuadLanes q;
+    int i = 0;
+    for (; i + 4 <= d.count; i += 4)
+    {
+        __m128 s, c;
+        sinCosSSE2(_mm_mul_ps(_mm_loadu_ps(&d.rotation[i]), _mm_set1_ps(DEG_TO_RAD)), s, c, false);
+        __m128 hsize = _mm_mul_ps(_mm_loadu_ps(&d.size[i]), half);
+        __m128 hc = _mm_mul_ps(c, hsize);
+        __m128 hs = _mm_mul_ps(s, hsize);
+        __m128 x = _mm_loadu_ps(&d.x[i]);
+        __m128 y = _mm_loadu_ps(&d.y[i]);
+        _mm_store_ps(q.x[0], _mm_add_ps(_mm_sub_ps(x, hc), hs));
+        _mm_store_ps(q.y[0], _mm_sub_ps(_mm_sub_ps(y, hs), hc));
+        _mm_store_ps(q.x[1], _mm_add_ps(_mm_add_ps(x, hc), hs));
+        _mm_store_ps(q.y[1], _mm_sub_ps(_mm_add_ps(y, hs), hc));
+        _mm_store_ps(q.x[2], _mm_sub_ps(_mm_add_ps(x, hc), hs));
+        _mm_store_ps(q.y[2], _mm_add_ps(_mm_add_ps(y, hs), hc));
+        _mm_store_ps(q.x[3], _mm_sub_ps(_mm_sub_ps(x, hc), hs));
+        _mm_store_ps(q.y[3], _mm_add_ps(_mm_sub_ps(y, hs), hc));
+        __m128i color = _mm_or_si128(_mm_or_si128(u8(d.r, i, R_SHIFT), u8(d.g, i, G_SHIFT)), _mm_or_si128(u8(d.b, i, B_SHIFT), u8(d.a, i, A_SHIFT)));
+        _mm_store_si128((__m128i*)q.color, color);
+        storeQuads(q, 4, &d.frame[i], texCoords, out + i * 4);
+    }
+    buildQuadVerticesScalar(d, i, texCoords, out);
+}
+
+PARTICLE_TARGET_AVX2 static void buildQuadVerticesAVX2(const ParticleDrawData& d, const SDL_FRect* texCoords, SDL_Vertex* out)
+{
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 scale = _mm256_set1_ps(255.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    QuadLanes q;
+    int i = 0;
+    for (; i + 8 <= d.count; i += 8)
+    {
+        __m256 s, c;
+        sinCosAVX2(_mm256_mul_ps(_mm256_loadu_ps(&d.rotation[i]), _mm256_set1_ps(DEG_TO_RAD)), s, c, false);
+        __m256 hsize = _mm256_mul_ps(_mm256_loadu_ps(&d.size[i]), half);
+        __m256 hc = _mm256_mul_ps(c, hsize);
+        __m256 hs = _mm256_mul_ps(s, hsize);
+        __m256 x = _mm256_loadu_ps(&d.x[i]);
+        __m256 y = _mm256_loadu_ps(&d.y[i]);
+        _mm256_store_ps(q.x[0], _mm256_add_ps(_mm256_sub_ps(x, hc), hs));
+        _mm256_store_ps(q.y[0], _mm256_sub_ps(_mm256_sub_ps(y, hs), hc));
+        _mm256_store_ps(q.x[1], _mm256_add_ps(_mm256_add_ps(x, hc), hs));
+        _mm256_store_ps(q.y[1], _mm256_sub_ps(_mm256_add_ps(y, hs), hc));
+        _mm256_store_ps(q.x[2], _mm256_sub_ps(_mm256_add_ps(x, hc), hs));
+        _mm256_store_ps(q.y[2], _mm256_add_ps(_mm256_add_ps(y, hs), hc));
+        _mm256_store_ps(q.x[3], _mm256_sub_ps(_mm256_sub_ps(x, hc), hs));
+        _mm256_store_ps(q.y[3], _mm256_add_ps(_mm256_sub_ps(y, hs), hc));
+        //saturate to [0, 255], truncate, then pack the 4 channels of each particle into one dword
+        __m256i r = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&d.r[i]), scale), zero), scale));
+        __m256i g = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&d.g[i]), scale), zero), scale));
+        __m256i b = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&d.b[i]), scale), zero), scale));
+        __m256i a = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&d.a[i]), scale), zero), scale));
+        __m256i color = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, R_SHIFT), _mm256_slli_epi32(g, G_SHIFT)),
+            _mm256_or_si256(_mm256_slli_epi32(b, B_SHIFT), _mm256_slli_epi32(a, A_SHIFT)));
+        _mm256_store_si256((__m256i*)q.color, color);
+        storeQuads(q, 8, &d.frame[i], texCoords, out + i * 4);
+    }
+    buildQuadVerticesScalar(d, i, texCoords, out);
+}
+#endif
+
+//rasterizer: pixels of a row are tested for coverage 4 at a time, then the covered ones are blended as [r, g, b, a]
+static inline __m128 loadPixelSSE2(const Uint8* p)
+{
+    Uint32 v;
+    memcpy(&v, p, 4);
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(v)), zero), zero));
+}
+
+static inline void storePixelSSE2(Uint8* p, __m128 v)
+{
+    __m128i i = _mm_cvtps_epi32(v);
+    i = _mm_packs_epi32(i, i);
+    i = _mm_packus_epi16(i, i);
+    int out = _mm_cvtsi128_si32(i);
+    memcpy(p, &out, 4);
+}
+
+static void rasterizeQuadSSE2(const ParticleSoftwareQuad& q, Uint8* pixels, int pitch, const SDL_Rect& clip)
+{
+    int x0, y0, x1, y1;
+    clipQuad(q, clip, x0, y0, x1, y1);
+    const __m128 color = _mm_setr_ps(q.r, q.g, q.b, q.a);
+    const __m128 rgb = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    const __m128 alpha_one = _mm_setr_ps(0, 0, 0, 1);
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 inv255 = _mm_set1_ps(1.0f / 255);
+    const __m128 offset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 ux = _mm_set1_ps(q.ux), uy = _mm_set1_ps(q.uy), half = _mm_set1_ps(0.5f);
+    alignas(16) float us[4], vs[4];
+    for (int y = y0; y < y1; y++)
+    {
+        float dyf = y + 0.5f - q.y;
+        __m128 dy = _mm_set1_ps(dyf);
+        Uint8* row = pixels + y * pitch;
+        for (int x = x0; x < x1; x += 4)
+        {
+            __m128 dx = _mm_add_ps(_mm_set1_ps(x - q.x), offset);
+            __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ux), _mm_mul_ps(dy, uy)), half);
+            __m128 v = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(dy, ux), _mm_mul_ps(dx, uy)), half);
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmplt_ps(u, one)),
+                _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmplt_ps(v, one)));
+            int mask = _mm_movemask_ps(inside) & ((1 << (std::min)(x1 - x, 4)) - 1);
+            if (mask == 0)
+            {
+                continue;
+            }
+            _mm_store_ps(us, u);
+            _mm_store_ps(vs, v);
+            for (int l = 0; l < 4; l++)
+            {
+                if ((mask >> l & 1) == 0)
+                {
+                    continue;
+                }
+                Uint8* dst = row + (x + l) * 4;
+                __m128 src = _mm_mul_ps(loadPixelSSE2(fetchTexel(q, us[l], vs[l])), color);
+                __m128 a = _mm_mul_ps(_mm_shuffle_ps(src, src, _MM_SHUFFLE(3, 3, 3, 3)), inv255);
+                __m128 d = loadPixelSSE2(dst);
+                if (q.additive)
+                {
+                    d = _mm_add_ps(d, _mm_mul_ps(src, _mm_and_ps(a, rgb)));
+                }
+                else
+                {
+                    //the alpha of the source is kept, the colors are weighted by it
+                    d = _mm_add_ps(_mm_mul_ps(src, _mm_or_ps(_mm_and_ps(a, rgb), alpha_one)), _mm_mul_ps(d, _mm_sub_ps(one, a)));
+                }
+                storePixelSSE2(dst, d);
+            }
+        }
+    }
+}
+
+#endif    // PARTICLE_SIMD_X86
+
+#ifdef PARTICLE_SIMD_NEON
+
+template <bool ACCELERATION, bool GRAVITY>
+static void updateGravityNEON(ParticleData& p, int begin, int end, float dt, const Vec2& gravity, float yFlip)
+{
+    const float32x4_t vdt = vdupq_n_f32(dt);
+    const float32x4_t vflip = vdupq_n_f32(yFlip);
+    const float32x4_t gx = vdupq_n_f32(gravity.x);
+    const float32x4_t gy = vdupq_n_f32(gravity.y);
+    const float32x4_t eps = vdupq_n_f32(1e-5f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        float32x4_t x = vld1q_f32(p.posx + i);
+        float32x4_t y = vld1q_f32(p.posy + i);
+        float32x4_t dx = vld1q_f32(p.modeA.dirX + i);
+        float32x4_t dy = vld1q_f32(p.modeA.dirY + i);
+        if constexpr (ACCELERATION || GRAVITY)
+        {
+            float32x4_t ax = vdupq_n_f32(0), ay = vdupq_n_f32(0);
+            if constexpr (ACCELERATION)
+            {
+                float32x4_t n = vsqrtq_f32(vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y)));
+                uint32x4_t mask = vcgeq_f32(n, eps);
+                float32x4_t inv = vreinterpretq_f32_u32(vandq_u32(mask, vreinterpretq_u32_f32(vdivq_f32(one, n))));
+                float32x4_t rx = vmulq_f32(x, inv);
+                float32x4_t ry = vmulq_f32(y, inv);
+
+                float32x4_t radial = vld1q_f32(p.modeA.radialAccel + i);
+                float32x4_t tangential = vld1q_f32(p.modeA.tangentialAccel + i);
+                ax = vaddq_f32(vmulq_f32(rx, radial), vmulq_f32(ry, vnegq_f32(tangential)));
+                ay = vaddq_f32(vmulq_f32(ry, radial), vmulq_f32(rx, tangential));
+            }
+            if constexpr (GRAVITY)
+            {
+                ax = vaddq_f32(ax, gx);
+                ay = vaddq_f32(ay, gy);
+            }
+            dx = vaddq_f32(dx, vmulq_f32(ax, vdt));
+            dy = vaddq_f32(dy, vmulq_f32(ay, vdt));
+            vst1q_f32(p.modeA.dirX + i, dx);
+            vst1q_f32(p.modeA.dirY + i, dy);
+        }
+
+        vst1q_f32(p.posx + i, vaddq_f32(x, vmulq_f32(vmulq_f32(dx, vdt), vflip)));
+        vst1q_f32(p.posy + i, vaddq_f32(y, vmulq_f32(vmulq_f32(dy, vdt), vflip)));
+    }
+    updateGravityScalar<ACCELERATION, GRAVITY>(p, i, end, dt, gravity, yFlip);
+}
+
+static void accumulateBoundsNEON(const ParticleData& p, int begin, int end, ParticleBounds& b)
+{
+    float32x4_t min_x = vdupq_n_f32(b.minX), min_y = vdupq_n_f32(b.minY);
+    float32x4_t max_x = vdupq_n_f32(b.maxX), max_y = vdupq_n_f32(b.maxY);
+    int i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        float32x4_t x = vaddq_f32(vld1q_f32(p.posx + i), vld1q_f32(p.startPosX + i));
+        float32x4_t y = vaddq_f32(vld1q_f32(p.posy + i), vld1q_f32(p.startPosY + i));
+        float32x4_t e = vmulq_n_f32(vld1q_f32(p.size + i), HALF_DIAGONAL);
+        min_x = vminq_f32(min_x, vsubq_f32(x, e));
+        min_y = vminq_f32(min_y, vsubq_f32(y, e));
+        max_x = vmaxq_f32(max_x, vaddq_f32(x, e));
+        max_y = vmaxq_f32(max_y, vaddq_f32(y, e));
+    }
+    b.minX = vminvq_f32(min_x);
+    b.minY = vminvq_f32(min_y);
+    b.maxX = vmaxvq_f32(max_x);
+    b.maxY = vmaxvq_f32(max_y);
+    accumulateBoundsScalar(p, i, end, b);
+}
+
+static inline void sinCosNEON(float32x4_t x, float32x4_t& s, float32x4_t& c, bool fast)
+{
+    const int32x4_t one = vdupq_n_s32(1);
+    const int32x4_t two = vdupq_n_s32(2);
+    int32x4_t k = vcvtnq_s32_f32(vmulq_f32(x, vdupq_n_f32(TWO_OVER_PI)));
+    float32x4_t kf = vcvtq_f32_s32(k);
+    float32x4_t r = vsubq_f32(x, vmulq_f32(kf, vdupq_n_f32(PIO2_1)));
+    r = vsubq_f32(r, vmulq_f32(kf, vdupq_n_f32(PIO2_2)));
+    r = vsubq_f32(r, vmulq_f32(kf, vdupq_n_f32(PIO2_3)));
+    float32x4_t z = vmulq_f32(r, r);
+    float32x4_t sr, cr;
+    if (fast)
+    {
+        sr = vaddq_f32(vdupq_n_f32(FAST_SIN_1), vmulq_f32(z, vdupq_n_f32(FAST_SIN_2)));
+        cr = vaddq_f32(vdupq_n_f32(FAST_COS_1), vmulq_f32(z, vdupq_n_f32(FAST_COS_2)));
+    }
+    else
+    {
+        sr = vaddq_f32(vdupq_n_f32(SIN_2), vmulq_f32(z, vdupq_n_f32(SIN_3)));
+        sr = vaddq_f32(vdupq_n_f32(SIN_1), vmulq_f32(z, sr));
+        cr = vaddq_f32(vdupq_n_f32(COS_3), vmulq_f32(z, vdupq_n_f32(COS_4)));
+        cr = vaddq_f32(vdupq_n_f32(COS_2), vmulq_f32(z, cr));
+        cr = vaddq_f32(vdupq_n_f32(COS_1), vmulq_f32(z, cr));
+    }
+    sr = vaddq_f32(r, vmulq_f32(vmulq_f32(r, z), sr));
+    cr = vaddq_f32(vdupq_n_f32(1.0f), vmulq_f32(z, cr));
+
+    uint32x4_t swap = vceqq_s32(vandq_s32(k, one), one);
+    float32x4_t s0 = vbslq_f32(swap, cr, sr);
+    float32x4_t c0 = vbslq_f32(swap, sr, cr);
+    uint32x4_t s_sign = vshlq_n_u32(vreinterpretq_u32_s32(vandq_s32(k, two)), 30);
+    uint32x4_t c_sign = vshlq_n_u32(vreinterpretq_u32_s32(vandq_s32(vaddq_s32(k, one), two)), 30);
+    s = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(s0), s_sign));
+    c = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(c0), c_sign));
+}
+
+static void sinCosNEON(const float* x, float* s, float* c, int n, TrigPrecision precision)
+{
+    if (precision == TrigPrecision::LIBM)
+    {
+        sinCosScalar(x, s, c, n, precision);
+        return;
+    }
+    bool fast = precision == TrigPrecision::FAST;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t vs, vc;
+        sinCosNEON(vld1q_f32(x + i), vs, vc, fast);
+        vst1q_f32(s + i, vs);
+        vst1q_f32(c + i, vc);
+    }
+    sinCosScalar(x + i, s + i, c + i, n - i, precision);
+}
+
+static void spawnRandomNEON(float* out, int n, Uint32 key, Uint32 serial, float base, float var, float scale, float lo, float hi)
+{
+    const uint32x4_t vkey = vdupq_n_u32(key);
+    const uint32x4_t hash1 = vdupq_n_u32(HASH_1);
+    const uint32x4_t hash2 = vdupq_n_u32(HASH_2);
+    const uint32x4_t exponent = vdupq_n_u32(0x40000000);
+    const float32x4_t three = vdupq_n_f32(3.0f);
+    const float32x4_t vbase = vdupq_n_f32(base);
+    const float32x4_t vvar = vdupq_n_f32(var);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    const float32x4_t vlo = vdupq_n_f32(lo);
+    const float32x4_t vhi = vdupq_n_f32(hi);
+    const uint32_t lanes[4] = { 0, 1, 2, 3 };
+    uint32x4_t vserial = vaddq_u32(vdupq_n_u32(serial), vld1q_u32(lanes));
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint32x4_t x = veorq_u32(vserial, vkey);
+        x = veorq_u32(x, vshrq_n_u32(x, 16));
+        x = vmulq_u32(x, hash1);
+        x = veorq_u32(x, vshrq_n_u32(x, 15));
+        x = vmulq_u32(x, hash2);
+        x = veorq_u32(x, vshrq_n_u32(x, 16));
+        float32x4_t r = vsubq_f32(vreinterpretq_f32_u32(vorrq_u32(vshrq_n_u32(x, 9), exponent)), three);
+        float32x4_t v = vmulq_f32(vaddq_f32(vbase, vmulq_f32(vvar, r)), vscale);
+        //selects like std::max/std::min, vmaxq/vminq would order the signed zeros
+        v = vbslq_f32(vcltq_f32(v, vlo), vlo, v);
+        v = vbslq_f32(vcltq_f32(vhi, v), vhi, v);
+        vst1q_f32(out + i, v);
+        vserial = vaddq_u32(vserial, vdupq_n_u32(4));
+    }
+    spawnRandomScalar(out + i, n - i, key, serial + Uint32(i), base, var, scale, lo, hi);
+}
+
+template <bool DELTA_RADIUS>
+static void updateRadiusNEON(ParticleData& p, int begin, int end, float dt, float yFlip, TrigPrecision precision)
+{
+    if (precision == TrigPrecision::LIBM)
+    {
+        updateRadiusScalar<DELTA_RADIUS>(p, begin, end, dt, yFlip, precision);
+        return;
+    }
+    bool fast = precision == TrigPrecision::FAST;
+    const float32x4_t vdt = vdupq_n_f32(dt);
+    const float32x4_t vflip = vdupq_n_f32(yFlip);
+    int i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        float32x4_t angle = vaddq_f32(vld1q_f32(p.modeB.angle + i), vmulq_f32(vld1q_f32(p.modeB.degreesPerSecond + i), vdt));
+        float32x4_t radius = vld1q_f32(p.modeB.radius + i);
+        vst1q_f32(p.modeB.angle + i, angle);
+        if constexpr (DELTA_RADIUS)
+        {
+            radius = vaddq_f32(radius, vmulq_f32(vld1q_f32(p.modeB.deltaRadius + i), vdt));
+            vst1q_f32(p.modeB.radius + i, radius);
+        }
+        float32x4_t vs, vc;
+        sinCosNEON(angle, vs, vc, fast);
+        vst1q_f32(p.posx + i, vmulq_f32(vnegq_f32(vc), radius));
+        vst1q_f32(p.posy + i, vmulq_f32(vmulq_f32(vnegq_f32(vs), radius), vflip));
+    }
+    updateRadiusScalar<DELTA_RADIUS>(p, i, end, dt, yFlip, precision);
+}
+
+#ifdef PARTICLE_QUAD_KERNELS
+static void buildQuadVerticesNEON(const ParticleDrawData& d, const SDL_FRect* texCoords, SDL_Vertex* out)
+{
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const float32x4_t scale = vdupq_n_f32(255.0f);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    auto u8 = [&](const std::vector<float>& v, int i, int shift)
+    {
+        float32x4_t f = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(&v[i]), scale), zero), scale);
+        return vshlq_u32(vcvtq_u32_f32(f), vdupq_n_s32(shift));
+    };
+    QuadLanes q;
+    int i = 0;
+    for (; i + 4 <= d.count; i += 4)
+    {
+        float32x4_t s, c;
+        sinCosNEON(vmulq_f32(vld1q_f32(&d.rotation[i]), vdupq_n_f32(DEG_TO_RAD)), s, c, false);
+        float32x4_t hsize = vmulq_f32(vld1q_f32(&d.size[i]), half);
+        float32x4_t hc = vmulq_f32(c, hsize);
+        float32x4_t hs = vmulq_f32(s, hsize);
+        float32x4_t x = vld1q_f32(&d.x[i]);
+        float32x4_t y = vld1q_f32(&d.y[i]);
+        vst1q_f32(q.x[0], vaddq_f32(vsubq_f32(x, hc), hs));
+        vst1q_f32(q.y[0], vsubq_f32(vsubq_f32(y, hs), hc));
+        vst1q_f32(q.x[1], vaddq_f32(vaddq_f32(x, hc), hs));
+        vst1q_f32(q.y[1], vsubq_f32(vaddq_f32(y, hs), hc));
+        vst1q_f32(q.x[2], vsubq_f32(vaddq_f32(x, hc), hs));
+        vst1q_f32(q.y[2], vaddq_f32(vaddq_f32(y, hs), hc));
+        vst1q_f32(q.x[3], vsubq_f32(vsubq_f32(x, hc), hs));
+        vst1q_f32(q.y[3], vaddq_f32(vsubq_f32(y, hs), hc));
+        uint32x4_t color = vorrq_u32(vorrq_u32(u8(d.r, i, R_SHIFT), u8(d.g, i, G_SHIFT)), vorrq_u32(u8(d.b, i, B_SHIFT), u8(d.a, i, A_SHIFT)));
+        vst1q_u32(q.color, color);
+        storeQuads(q, 4, &d.frame[i], texCoords, out + i * 4);
+    }
+    buildQuadVerticesScalar(d, i, texCoords, out);
+}
+#endif
+
+static inline float32x4_t loadPixelNEON(const Uint8* p)
+{
+    Uint32 v;
+    memcpy(&v, p, 4);
+    uint16x4_t w = vget_low_u16(vmovl_u8(vcreate_u8(v)));
+    return vcvtq_f32_u32(vmovl_u16(w));
+}
+
+static inline void storePixelNEON(Uint8* p, float32x4_t v)
+{
+    uint16x4_t w = vqmovn_u32(vcvtnq_u32_f32(vmaxq_f32(v, vdupq_n_f32(0))));
+    uint8x8_t b = vqmovn_u16(vcombine_u16(w, w));
+    Uint32 out = vget_lane_u32(vreinterpret_u32_u8(b), 0);
+    memcpy(p, &out, 4);
+}
+
+static void rasterizeQuadNEON(const ParticleSoftwareQuad& q, Uint8* pixels, int pitch, const SDL_Rect& clip)
+{
+    int x0, y0, x1, y1;
+    clipQuad(q, clip, x0, y0, x1, y1);
+    const float colors[4] = { q.r, q.g, q.b, q.a };
+    const float offsets[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
+    const float rgb_one[4] = { 1, 1, 1, 0 };
+    const float alpha_ones[4] = { 0, 0, 0, 1 };
+    const float32x4_t color = vld1q_f32(colors);
+    const float32x4_t offset = vld1q_f32(offsets);
+    const float32x4_t rgb = vld1q_f32(rgb_one);
+    const float32x4_t alpha_one = vld1q_f32(alpha_ones);
+    const float32x4_t one = vdupq_n_f32(1), zero = vdupq_n_f32(0), half = vdupq_n_f32(0.5f);
+    const float32x4_t ux = vdupq_n_f32(q.ux), uy = vdupq_n_f32(q.uy);
+    float us[4], vs[4];
+    uint32_t ms[4];
+    for (int y = y0; y < y1; y++)
+    {
+        float32x4_t dy = vdupq_n_f32(y + 0.5f - q.y);
+        Uint8* row = pixels + y * pitch;
+        for (int x = x0; x < x1; x += 4)
+        {
+            float32x4_t dx = vaddq_f32(vdupq_n_f32(x - q.x), offset);
+            float32x4_t u = vaddq_f32(vaddq_f32(vmulq_f32(dx, ux), vmulq_f32(dy, uy)), half);
+            float32x4_t v = vaddq_f32(vsubq_f32(vmulq_f32(dy, ux), vmulq_f32(dx, uy)), half);
+            uint32x4_t inside = vandq_u32(vandq_u32(vcgeq_f32(u, zero), vcltq_f32(u, one)), vandq_u32(vcgeq_f32(v, zero), vcltq_f32(v, one)));
+            if (vmaxvq_u32(inside) == 0)
+            {
+                continue;
+            }
+            vst1q_f32(us, u);
+            vst1q_f32(vs, v);
+            vst1q_u32(ms, inside);
+            for (int l = 0; l < 4 && x + l < x1; l++)
+            {
+                if (ms[l] == 0)
+                {
+                    continue;
+                }
+                Uint8* dst = row + (x + l) * 4;
+                float32x4_t src = vmulq_f32(loadPixelNEON(fetchTexel(q, us[l], vs[l])), color);
+                float32x4_t a = vmulq_n_f32(vdupq_laneq_f32(src, 3), 1.0f / 255);
+                float32x4_t d = loadPixelNEON(dst);
+                if (q.additive)
+                {
+                    d = vaddq_f32(d, vmulq_f32(src, vmulq_f32(a, rgb)));
+                }
+                else
+                {
+                    d = vaddq_f32(vmulq_f32(src, vaddq_f32(vmulq_f32(a, rgb), alpha_one)), vmulq_f32(d, vsubq_f32(one, a)));
+                }
+                storePixelNEON(dst, d);
+            }
+        }
+    }
+}
+
+#endif    // PARTICLE_SIMD_NEON
+
+//dispatch
+
+struct KernelTable
+{
+    ISA isa;
+    //indexed by ACCELERATION | GRAVITY << 1
+    void (*updateGravity[4])(ParticleData& p, int begin, int end, float dt, const Vec2& gravity, float yFlip);
+    //indexed by DELTA_RADIUS
+    void (*updateRadius[2])(ParticleData& p, int begin, int end, float dt, float yFlip, TrigPrecision precision);
+    void (*sinCos)(const float* x, float* s, float* c, int n, TrigPrecision precision);
+    void (*accumulateBounds)(const ParticleData& p, int begin, int end, ParticleBounds& bounds);
+    void (*spawnRandom)(float* out, int n, Uint32 key, Uint32 serial, float base, float var, float scale, float lo, float hi);
+    void (*rasterizeQuad)(const ParticleSoftwareQuad& q, Uint8* pixels, int pitch, const SDL_Rect& clip);
+#ifdef PARTICLE_QUAD_KERNELS
+    void (*buildQuadVertices)(const ParticleDrawData& d, const SDL_FRect* texCoords, SDL_Vertex* out);
+#define QUAD_KERNEL(f) , f
+#else
+#define QUAD_KERNEL(f)
+#endif
+};
+
+#define GRAVITY_KERNELS(f) { f<false, false>, f<true, false>, f<false, true>, f<true, true> }
+#define RADIUS_KERNELS(f) { f<false>, f<true> }
+
+static const KernelTable scalar_table = { ISA::SCALAR, GRAVITY_KERNELS(updateGravityScalar), RADIUS_KERNELS(updateRadiusScalar), sinCosScalar, accumulateBoundsScalar, spawnRandomScalar, rasterizeQuadScalar QUAD_KERNEL(buildQuadVerticesScalar) };
+#ifdef PARTICLE_SIMD_X86
+static const KernelTable sse2_table = { ISA::SSE2, GRAVITY_KERNELS(updateGravitySSE2), RADIUS_KERNELS(updateRadiusSSE2), sinCosSSE2, accumulateBoundsSSE2, spawnRandomSSE2, rasterizeQuadSSE2 QUAD_KERNEL(buildQuadVerticesSSE2) };
+static const KernelTable avx2_table = { ISA::AVX2, GRAVITY_KERNELS(updateGravityAVX2), RADIUS_KERNELS(updateRadiusAVX2), sinCosAVX2, accumulateBoundsAVX2, spawnRandomAVX2, rasterizeQuadSSE2 QUAD_KERNEL(buildQuadVerticesAVX2) };
+#endif
+#ifdef PARTICLE_SIMD_NEON
+static const KernelTable neon_table = { ISA::NEON, GRAVITY_KERNELS(updateGravityNEON), RADIUS_KERNELS(updateRadiusNEON), sinCosNEON, accumulateBoundsNEON, spawnRandomNEON, rasterizeQuadNEON QUAD_KERNEL(buildQuadVerticesNEON) };
+#endif
+
+static const KernelTable* findTable(ISA isa)
+{
+    switch (isa)
+    {
+#ifdef PARTICLE_SIMD_X86
+    case ISA::AVX2:
+        return SDL_HasAVX2() ? &avx2_table : nullptr;
+    case ISA::SSE2:
+        return SDL_HasSSE2() ? &sse2_table : nullptr;
+#endif
+#ifdef PARTICLE_SIMD_NEON
+    case ISA::NEON:
+        return &neon_table;
+#endif
+    case ISA::SCALAR:
+        return &scalar_table;
+    default:
+        return nullptr;
+    }
+}
+
+ISA getBestISA()
+{
+    static const ISA best = []
+    {
+        for (auto isa : { ISA::AVX2, ISA::NEON, ISA::SSE2 })
+        {
+            if (findTable(isa))
+            {
+                return isa;
+            }
+        }
+        return ISA::SCALAR;
+    }();
+    return best;
+}
+
+static std::atomic<const KernelTable*> current_table{ nullptr };
+
+static const KernelTable& table()
+{
+    auto t = current_table.load(std::memory_order_acquire);
+    if (t == nullptr)
+    {
+        t = findTable(getBestISA());
+        current_table.store(t, std::memory_order_release);
+    }
+    return *t;
+}
+
+ISA getISA()
+{
+    return table().isa;
+}
+
+void setISA(ISA isa)
+{
+    auto t = findTable(isa);
+    if (t == nullptr)
+    {
+        t = findTable(getBestISA());
+    }
+    current_table.store(t, std::memory_order_release);
+}
+
+const char* getISAName(ISA isa)
+{
+    switch (isa)
+    {
+    case ISA::SSE2:
+        return "SSE2";
+    case ISA::AVX2:
+        return "AVX2";
+    case ISA::NEON:
+        return "NEON";
+    default:
+        return "Scalar";
+    }
+}
+
+void updateGravity(ParticleData& p, int begin, int end, float dt, const Vec2& gravity, float yFlip, unsigned int features)
+{
+    int kernel = (features & FEATURE_ACCELERATION ? 1 : 0) | (gravity.x != 0 || gravity.y != 0 ? 2 : 0);
+    table().updateGravity[kernel](p, begin, end, dt, gravity, yFlip);
+}
+
+void updateRadius(ParticleData& p, int begin, int end, float dt, float yFlip, TrigPrecision precision, unsigned int features)
+{
+    table().updateRadius[features & FEATURE_DELTA_RADIUS ? 1 : 0](p, begin, end, dt, yFlip, precision);
+}
+
+void sinCos(const float* x, float* s, float* c, int n, TrigPrecision precision)
+{
+    table().sinCos(x, s, c, n, precision);
+}
+
+void accumulateBounds(const ParticleData& p, int begin, int end, ParticleBounds& bounds)
+{
+    table().accumulateBounds(p, begin, end, bounds);
+}
+
+void spawnRandom(float* out, int n, Uint32 key, Uint32 serial, float base, float var, float scale, float lo, float hi)
+{
+    table().spawnRandom(out, n, key, serial, base, var, scale, lo, hi);
+}
+
+#ifdef PARTICLE_QUAD_KERNELS
+void buildQuadVertices(const ParticleDrawData& d, const SDL_FRect* texCoords, SDL_Vertex* out)
+{
+    table().buildQuadVertices(d, texCoords, out);
+}
+#endif
+
+void rasterizeQuad(const ParticleSoftwareQuad& q, Uint8* pixels, int pitch, const SDL_Rect& clip)
+{
+    table().rasterizeQuad(q, pixels, pitch, clip);
+}
+
+}    // namespace ParticleKernels
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "ParticleSoftwareRenderer.h"
+#include "ParticleSystem.h"
+#include <cstring>
+
+/** SIMD kernels for the hot loops of ParticleSystem.
+ * Every kernel has a scalar version. x86 builds also have SSE2 and AVX2 versions, the best one supported by the CPU
+ * is selected at runtime. AArch64 builds with NEON use the NEON version.
+ * The kernels work on the particle range [begin, end) of a ParticleData.
+ */
+namespace ParticleKernels
+{
+enum class ISA
+{
+    SCALAR,
+    SSE2,
+    AVX2,
+    NEON,
+};
+
+/** The best instruction set supported by both the compiler and the CPU. */
+ISA getBestISA();
+/** Gets the instruction set used by the kernels at the moment. */
+ISA getISA();
+/** Forces the kernels to an instruction set, mainly for comparing the results and the speed.
+ * An instruction set which is not supported falls back to the best one.
+ */
+void setISA(ISA isa);
+const char* getISAName(ISA isa);
+
+/** The parts of the update which are not zero for all the particles alive, as flags. The update kernels are
+ * specialized for each combination, so the parts which are zero are not computed. Whether there is gravity is
+ * taken from the gravity vector.
+ */
+enum Feature
+{
+    FEATURE_ACCELERATION = 1,    //radial or tangential acceleration, gravity mode
+    FEATURE_DELTA_RADIUS = 2,    //the radius changes, radius mode
+    FEATURE_DELTA_COLOR = 4,
+    FEATURE_DELTA_SIZE = 8,
+    FEATURE_DELTA_ROTATION = 16,
+    FEATURE_ALL = 0xff,
+};
+
+/** Gravity mode: radial, tangential and gravity acceleration, then moves the particles.
+ * The vector versions use the same operation order and IEEE sqrt/div as the scalar one, so the results are bitwise
+ * identical when the compiler does not contract the scalar code into FMA. Where it does (e.g. AArch64), the difference
+ * is within 2 ulp of the position per step.
+ */
+void updateGravity(ParticleData& p, int begin, int end, float dt, const Vec2& gravity, float yFlip, unsigned int features = FEATURE_ALL);
+
+/** Radius mode: rotates the particles around the source and moves them along the radius.
+ * With TrigPrecision::LIBM it always runs the scalar version with sinf/cosf.
+ */
+void updateRadius(ParticleData& p, int begin, int end, float dt, float yFlip, ParticleSystem::TrigPrecision precision, unsigned int features = FEATURE_ALL);
+
+/** Merges the particles in [begin, end) into bounds, each as its position plus the half of the diagonal of its size
+ * in all directions, which contains the square rotated by any angle.
+ */
+void accumulateBounds(const ParticleData& p, int begin, int end, ParticleBounds& bounds);
+
+static const Uint32 HASH_1 = 0x7feb352d;
+static const Uint32 HASH_2 = 0x846ca68b;
+
+/** An integer hash with a low bias, every bit of the input changes half the bits of the output. */
+inline Uint32 hash32(Uint32 x)
+{
+    x ^= x >> 16;
+    x *= HASH_1;
+    x ^= x >> 15;
+    x *= HASH_2;
+    x ^= x >> 16;
+    return x;
+}
+
+/** A counter-based random number in [-1, 1): the same key and serial always give the same number.
+ * The key is a hash of the seed of a system and an attribute, the serial is the serial number of a particle.
+ */
+inline float random11(Uint32 key, Uint32 serial)
+{
+    Uint32 bits = (hash32(serial ^ key) >> 9) | 0x40000000;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f - 3.0f;
+}
+
+/** out[i] = clamp((base + var * random11(key, serial + i)) * scale, lo, hi) for i in [0, n), the random attribute
+ * of the spawned particles. The hash is integer and the rest is done in the same order as the scalar version,
+ * so all the instruction sets give the same bits; 8 (AVX2) or 4 (SSE2, NEON) numbers are made at once.
+ */
+void spawnRandom(float* out, int n, Uint32 key, Uint32 serial, float base, float var, float scale, float lo, float hi);
+
+/** s[i] = sin(x[i]), c[i] = cos(x[i]) for i in [0, n).
+ * The argument is reduced to [-pi/4, pi/4] in 3 steps (Cody-Waite), which is exact for |x| < 8192.
+ * Max absolute error measured against libm on [-8192, 8192]: ACCURATE 8.5e-8, FAST 1.3e-5.
+ */
+void sinCos(const float* x, float* s, float* c, int n, ParticleSystem::TrigPrecision precision);
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+/** Writes 4 vertices for each particle of d into out: the corners of the quad rotated like SDL_RenderCopyEx,
+ * the color packed to RGBA8 with saturation, and the texture coordinates of the frame of the particle.
+ * sin/cos of the rotations are computed for 8 (AVX2) or 4 (SSE2, NEON) particles at once.
+ *
+ * @param texCoords The frames in texture coordinates indexed by d.frame, nullptr for the whole texture.
+ */
+void buildQuadVertices(const ParticleDrawData& d, const SDL_FRect* texCoords, SDL_Vertex* out);
+#endif
+
+/** Rasterizes the part of a quad in clip into RGBA32 pixels. The coverage of 4 pixels is tested at once,
+ * and each covered pixel is blended as a vector of its 4 channels.
+ */
+void rasterizeQuad(const ParticleSoftwareQuad& q, Uint8* pixels, int pitch, const SDL_Rect& clip);
+}    // namespace ParticleKernels
@@ -0,0 +1,159 @@
+#include "ParticleRenderQueue.h"
+#include "ParticleKernels.h"
+#include <algorithm>
+#include <climits>
+#include <functional>
+
+void ParticleRenderQueue::clear()
+{
+    items_.clear();
+    vertex_count_ = 0;
+}
+
+void ParticleRenderQueue::add(ParticleSystem* system, int layer)
+{
+    auto& d = system->_drawData;
+    if (d.count == 0)
+    {
+        return;
+    }
+    Item item;
+    item.system = system;
+    item.renderer = system->_renderer;
+    item.texture = system->_texture;
+    item.blend = system->getBlendMode();
+    item.layer = layer;
+    item.orderIndependent = system->isOrderIndependent();
+    item.order = int(items_.size());
+    item.vertexBegin = 0;
+    item.quads = -1;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (system->_renderPath == ParticleSystem::RenderPath::GEOMETRY)
+    {
+        item.vertexBegin = vertex_count_;
+        item.quads = d.count;
+        vertex_count_ += d.count * 4;
+        if (int(vertices_.size()) < vertex_count_)
+        {
+            vertices_.resize(vertex_count_ + vertex_count_ / 2);
+        }
+        auto atlas = system->_atlas;
+        ParticleKernels::buildQuadVertices(d, atlas ? atlas->getTexCoords() : nullptr, &vertices_[item.vertexBegin]);
+    }
+#endif
+    items_.push_back(item);
+}
+
+void ParticleRenderQueue::flush()
+{
+    stats_ = Stats();
+    stats_.systems = int(items_.size());
+
+    //the state changes as if every system was rendered by itself
+    SDL_Texture* texture = nullptr;
+    SDL_BlendMode blend = SDL_BLENDMODE_INVALID;
+    for (auto& item : items_)
+    {
+        stats_.stateChangesUnsorted += (item.texture != texture) + (item.blend != blend);
+        texture = item.texture;
+        blend = item.blend;
+    }
+
+    //an order independent system commutes with the others of its kind, so it only has to stay between the order dependent
+    //layers under and over it: move it to the highest order dependent layer not over it, after the systems of that layer
+    layers_.clear();
+    for (auto& item : items_)
+    {
+        if (!item.orderIndependent)
+        {
+            layers_.push_back(item.layer);
+        }
+    }
+    std::sort(layers_.begin(), layers_.end());
+    for (auto& item : items_)
+    {
+        if (item.orderIndependent)
+        {
+            auto it = std::upper_bound(layers_.begin(), layers_.end(), item.layer);
+            item.layer = it == layers_.begin() ? INT_MIN : *(it - 1);
+        }
+    }
+
+    std::sort(items_.begin(), items_.end(), [](const Item& l, const Item& r)
+        {
+            if (l.layer != r.layer)
+            {
+                return l.layer < r.layer;
+            }
+            if (l.orderIndependent != r.orderIndependent)
+            {
+                return r.orderIndependent;
+            }
+            if (l.texture != r.texture)
+            {
+                return std::less<SDL_Texture*>()(l.texture, r.texture);
+            }
+            if (l.blend != r.blend)
+            {
+                return l.blend < r.blend;
+            }
+            return l.order < r.order;
+        });
+
+    texture = nullptr;
+    blend = SDL_BLENDMODE_INVALID;
+    for (size_t i = 0; i < items_.size();)
+    {
+        auto& item = items_[i];
+        stats_.stateChanges += (item.texture != texture) + (item.blend != blend);
+        texture = item.texture;
+        blend = item.blend;
+        stats_.particles += item.system->_drawData.count;
+        if (item.quads < 0)
+        {
+            //renderCopyEx sets the color of the texture for each particle
+            item.system->renderCopyEx();
+            stats_.submissions += item.system->_drawData.count;
+            texture = nullptr;
+            i++;
+            continue;
+        }
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        //merge the following systems with the same state
+        size_t end = i + 1;
+        int quads = item.quads;
+        while (end < items_.size() && items_[end].quads >= 0 && items_[end].texture == item.texture
+            && items_[end].blend == item.blend && items_[end].renderer == item.renderer)
+        {
+            stats_.particles += items_[end].system->_drawData.count;
+            quads += items_[end].quads;
+            end++;
+        }
+        if (int(indices_.size()) < quads * 6)
+        {
+            indices_.resize(quads * 6);
+        }
+        int* id = indices_.data();
+        for (size_t k = i; k < end; k++)
+        {
+            int v = items_[k].vertexBegin;
+            for (int q = 0; q < items_[k].quads; q++, v += 4, id += 6)
+            {
+                id[0] = v;
+                id[1] = v + 1;
+                id[2] = v + 2;
+                id[3] = v;
+                id[4] = v + 2;
+                id[5] = v + 3;
+            }
+        }
+        SDL_SetTextureColorMod(item.texture, 255, 255, 255);
+        SDL_SetTextureAlphaMod(item.texture, 255);
+        SDL_SetTextureBlendMode(item.texture, item.blend);
+        SDL_RenderGeometry(item.renderer, item.texture, vertices_.data(), vertex_count_, indices_.data(), quads * 6);
+        stats_.submissions++;
+        i = end;
+#endif
+    }
+    clear();
+}
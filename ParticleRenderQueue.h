@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ParticleSystem.h"
+
+/** Collects the particles of many systems in a frame and renders them together.
+ * The systems are sorted by (layer, texture, blend mode), then the neighbouring systems with the same texture and blend
+ * mode are merged into one SDL_RenderGeometry. The texture and blend mode are only set when they change.
+ * The layer is the first key, so a system in a higher layer is always rendered over those in lower layers.
+ * In the same layer the order of the systems is kept for the same texture and blend mode.
+ * Order independent (additive) systems are merged across layers: they are only kept between the order dependent systems
+ * of the layers under and over them, so all the additive systems between two such layers become one submission for
+ * each texture.
+ * The systems using RenderPath::COPY_EX are sorted too, but each of them is still rendered particle by particle.
+ * A system can be added once for each flush.
+ *
+ * @code
+ * queue.clear();
+ * for (auto p : systems)
+ * {
+ *     p->draw(queue);
+ * }
+ * queue.flush();
+ * @endcode
+ */
+class ParticleRenderQueue
+{
+public:
+    struct Stats
+    {
+        /** systems added since the last flush */
+        int systems = 0;
+        /** particles added since the last flush */
+        int particles = 0;
+        /** SDL_RenderGeometry and SDL_RenderCopyEx calls */
+        int submissions = 0;
+        /** changes of the texture or the blend mode between two submissions */
+        int stateChanges = 0;
+        /** state changes if every system was rendered by itself in the order they were added */
+        int stateChangesUnsorted = 0;
+        int getStateChangesSaved() const { return stateChangesUnsorted - stateChanges; }
+    };
+
+    /** Drops the systems added since the last flush. */
+    void clear();
+    /** Sorts, merges and renders the systems added since the last flush, then clears the queue.
+     * The statistics of this flush are kept until the next one.
+     */
+    void flush();
+    const Stats& getStats() const { return stats_; }
+
+private:
+    friend class ParticleSystem;
+    /** Called by ParticleSystem::draw(queue) after the draw data of the system is resolved. */
+    void add(ParticleSystem* system, int layer);
+
+    struct Item
+    {
+        ParticleSystem* system;
+        SDL_Renderer* renderer;
+        SDL_Texture* texture;
+        SDL_BlendMode blend;
+        int layer;
+        bool orderIndependent;
+        //the order of adding, the last key of sorting
+        int order;
+        //vertices of the quads in vertices_, quads < 0 means the system is rendered by SDL_RenderCopyEx
+        int vertexBegin;
+        int quads;
+    };
+    std::vector<Item> items_;
+    //layers of the order dependent systems in this flush
+    std::vector<int> layers_;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    std::vector<SDL_Vertex> vertices_;
+    std::vector<int> indices_;
+#endif
+    int vertex_count_ = 0;
+    Stats stats_;
+};
@@ -0,0 +1,170 @@
+#include "ParticleSoftwareRenderer.h"
+#include "ParticleKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+ParticleSoftwareRenderer::ParticleSoftwareRenderer(int width, int height, int threads)
+{
+    surface_ = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+    pool_.reset(new ParticleJobPool(threads));
+    tiles_x_ = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y_ = (height + TILE_SIZE - 1) / TILE_SIZE;
+    bins_.resize(tiles_x_ * tiles_y_);
+    clear();
+}
+
+ParticleSoftwareRenderer::~ParticleSoftwareRenderer()
+{
+    SDL_FreeSurface(surface_);
+}
+
+void ParticleSoftwareRenderer::setTextureImage(SDL_Texture* texture, SDL_Surface* image)
+{
+    auto converted = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0);
+    if (converted == nullptr)
+    {
+        return;
+    }
+    auto it = std::find_if(images_.begin(), images_.end(), [texture](const Image& i) { return i.texture == texture; });
+    if (it == images_.end())
+    {
+        images_.emplace_back();
+        it = images_.end() - 1;
+    }
+    it->texture = texture;
+    it->width = converted->w;
+    it->height = converted->h;
+    it->pixels.resize(converted->w * converted->h * 4);
+    SDL_LockSurface(converted);
+    for (int y = 0; y < converted->h; y++)
+    {
+        memcpy(&it->pixels[y * converted->w * 4], (const Uint8*)converted->pixels + y * converted->pitch, converted->w * 4);
+    }
+    SDL_UnlockSurface(converted);
+    SDL_FreeSurface(converted);
+}
+
+void ParticleSoftwareRenderer::clear(SDL_Color color)
+{
+    if (surface_ == nullptr)
+    {
+        return;
+    }
+    for (int y = 0; y < surface_->h; y++)
+    {
+        auto row = (Uint8*)surface_->pixels + y * surface_->pitch;
+        for (int x = 0; x < surface_->w; x++)
+        {
+            memcpy(row + x * 4, &color, 4);
+        }
+    }
+}
+
+void ParticleSoftwareRenderer::add(ParticleSystem* system)
+{
+    auto& d = system->_drawData;
+    if (surface_ == nullptr || d.count == 0)
+    {
+        return;
+    }
+    auto texture = system->_texture;
+    auto image = std::find_if(images_.begin(), images_.end(), [texture](const Image& i) { return i.texture == texture; });
+    auto atlas = system->_atlas;
+    bool additive = system->getBlendMode() == SDL_BLENDMODE_ADD;
+
+    angles_.resize(d.count);
+    sin_.resize(d.count);
+    cos_.resize(d.count);
+    for (int i = 0; i < d.count; i++)
+    {
+        angles_[i] = d.rotation[i] * 0.01745329252f;
+    }
+    ParticleKernels::sinCos(angles_.data(), sin_.data(), cos_.data(), d.count, ParticleSystem::TrigPrecision::FAST);
+
+    for (int i = 0; i < d.count; i++)
+    {
+        ParticleSoftwareQuad q;
+        //half of the extent of the rotated square
+        float extent = d.size[i] * 0.5f * (fabsf(cos_[i]) + fabsf(sin_[i]));
+        q.x0 = (std::max)(0, int(floorf(d.x[i] - extent)));
+        q.y0 = (std::max)(0, int(floorf(d.y[i] - extent)));
+        q.x1 = (std::min)(surface_->w, int(ceilf(d.x[i] + extent)));
+        q.y1 = (std::min)(surface_->h, int(ceilf(d.y[i] + extent)));
+        if (q.x0 >= q.x1 || q.y0 >= q.y1)
+        {
+            continue;
+        }
+        q.x = d.x[i];
+        q.y = d.y[i];
+        q.ux = cos_[i] / d.size[i];
+        q.uy = sin_[i] / d.size[i];
+        q.r = d.r[i];
+        q.g = d.g[i];
+        q.b = d.b[i];
+        q.a = d.a[i];
+        q.texels = nullptr;
+        q.texPitch = q.frameW = q.frameH = 1;
+        if (image != images_.end())
+        {
+            SDL_Rect frame = { 0, 0, image->width, image->height };
+            if (atlas)
+            {
+                frame = atlas->getFrame(d.frame[i]);
+                //the frame may be out of an image smaller than the texture
+                int x0 = (std::max)(0, frame.x), y0 = (std::max)(0, frame.y);
+                int x1 = (std::min)(image->width, frame.x + frame.w), y1 = (std::min)(image->height, frame.y + frame.h);
+                frame = { x0, y0, x1 - x0, y1 - y0 };
+            }
+            if (frame.w <= 0 || frame.h <= 0)
+            {
+                //nothing of the frame is in the image
+                continue;
+            }
+            q.texPitch = image->width * 4;
+            q.texels = &image->pixels[frame.y * q.texPitch + frame.x * 4];
+            q.frameW = frame.w;
+            q.frameH = frame.h;
+        }
+        q.additive = additive;
+        quads_.push_back(q);
+    }
+}
+
+void ParticleSoftwareRenderer::render()
+{
+    if (surface_ == nullptr)
+    {
+        return;
+    }
+    for (auto& bin : bins_)
+    {
+        bin.clear();
+    }
+    for (int i = 0; i < int(quads_.size()); i++)
+    {
+        auto& q = quads_[i];
+        for (int ty = q.y0 / TILE_SIZE; ty <= (q.y1 - 1) / TILE_SIZE; ty++)
+        {
+            for (int tx = q.x0 / TILE_SIZE; tx <= (q.x1 - 1) / TILE_SIZE; tx++)
+            {
+                bins_[ty * tiles_x_ + tx].push_back(i);
+            }
+        }
+    }
+
+    //each tile is filled by one thread of the pool
+    pool_->parallelFor(int(bins_.size()), [this](int tile) { renderTile(tile); });
+    quads_.clear();
+}
+
+void ParticleSoftwareRenderer::renderTile(int tile)
+{
+    SDL_Rect clip = { tile % tiles_x_ * TILE_SIZE, tile / tiles_x_ * TILE_SIZE, TILE_SIZE, TILE_SIZE };
+    clip.w = (std::min)(clip.w, surface_->w - clip.x);
+    clip.h = (std::min)(clip.h, surface_->h - clip.y);
+    for (int i : bins_[tile])
+    {
+        ParticleKernels::rasterizeQuad(quads_[i], (Uint8*)surface_->pixels, surface_->pitch, clip);
+    }
+}
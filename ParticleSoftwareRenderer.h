@@ -0,0 +1,90 @@
+#pragma once
+
+#include "ParticleJobPool.h"
+#include "ParticleSystem.h"
+#include <memory>
+
+/** A particle prepared for the software rasterizer. */
+struct ParticleSoftwareQuad
+{
+    //center of the quad, and the axes from a pixel to the texture coordinates (cos and sin of the rotation divided by
+    //the size): u = dx * ux + dy * uy + 0.5, v = dy * ux - dx * uy + 0.5, the pixel is inside when both are in [0, 1)
+    float x, y, ux, uy;
+    //color multiplied to the texels, in [0, 1]
+    float r, g, b, a;
+    //bounding box in pixels, the maximum is excluded
+    int x0, y0, x1, y1;
+    //texels of the frame in RGBA32, nullptr for a white square
+    const Uint8* texels;
+    int texPitch, frameW, frameH;
+    bool additive;
+};
+
+/** Rasterizes particles on the CPU into an RGBA32 surface, for rendering without a renderer or a GPU,
+ * e.g. thumbnails and replays on a server.
+ * The target is split into tiles of TILE_SIZE pixels and each quad is binned into the tiles it touches, then the tiles
+ * are filled on the threads of a ParticleJobPool, which are kept between the renders. In a tile the quads are drawn in
+ * the order they were added, so the result does not depend on the number of threads. The texels are sampled with the
+ * nearest filter and blended with SIMD, like SDL_BLENDMODE_BLEND or SDL_BLENDMODE_ADD by the blend mode of the system.
+ *
+ * @code
+ * ParticleSoftwareRenderer renderer(256, 256);
+ * renderer.setTextureImage(p->getTexture(), IMG_Load("fire.png"));
+ * renderer.clear();
+ * p->draw(renderer);
+ * renderer.render();
+ * IMG_SavePNG(renderer.getSurface(), "thumbnail.png");
+ * @endcode
+ */
+class ParticleSoftwareRenderer
+{
+public:
+    static const int TILE_SIZE = 64;
+
+    /** Creates the target surface.
+     *
+     * @param threads The number of threads filling the tiles, 0 for the number of CPUs.
+     */
+    ParticleSoftwareRenderer(int width, int height, int threads = 0);
+    ~ParticleSoftwareRenderer();
+    ParticleSoftwareRenderer(const ParticleSoftwareRenderer&) = delete;
+    ParticleSoftwareRenderer& operator=(const ParticleSoftwareRenderer&) = delete;
+
+    /** Sets the image sampled for the systems using a texture. A texture can not be read back from the renderer,
+     * so its image is given as a surface, which is copied and can be freed after.
+     * The particles of a texture without an image are drawn as white squares.
+     *
+     * @param texture The texture of the systems, can be nullptr for the systems without a texture.
+     * @param image The image, in any format.
+     */
+    void setTextureImage(SDL_Texture* texture, SDL_Surface* image);
+    /** Fills the target with a color. */
+    void clear(SDL_Color color = { 0, 0, 0, 0 });
+    /** Rasterizes the particles added since the last render into the target. */
+    void render();
+    /** Gets the target, its format is SDL_PIXELFORMAT_RGBA32. */
+    SDL_Surface* getSurface() const { return surface_; }
+    int getThreadCount() const { return pool_->getThreadCount(); }
+
+private:
+    friend class ParticleSystem;
+    /** Called by ParticleSystem::draw(renderer) after the draw data of the system is resolved. */
+    void add(ParticleSystem* system);
+    void renderTile(int tile);
+
+    struct Image
+    {
+        SDL_Texture* texture;
+        int width, height;
+        std::vector<Uint8> pixels;
+    };
+    SDL_Surface* surface_ = nullptr;
+    std::unique_ptr<ParticleJobPool> pool_;
+    std::vector<Image> images_;
+    std::vector<ParticleSoftwareQuad> quads_;
+    //angles, sin and cos of the rotations of a system
+    std::vector<float> angles_, sin_, cos_;
+    int tiles_x_ = 0, tiles_y_ = 0;
+    //indices of the quads touching each tile
+    std::vector<std::vector<int>> bins_;
+};
@@ -1,6 +1,11 @@
 #include "ParticleSystem.h"
+#include "ParticleBudget.h"
+#include "ParticleKernels.h"
+#include "ParticleRenderQueue.h"
+#include "ParticleSoftwareRenderer.h"
 #include <algorithm>
 #include <assert.h>
+#include <cmath>
 #include <string>
 
 inline float Deg2Rad(float a)
@@ -22,44 +27,107 @@ inline float clampf(float value, float min_inclusive, float max_inclusive)
     return value < min_inclusive ? min_inclusive : value < max_inclusive ? value : max_inclusive;
 }
 
-inline void normalize_point(float x, float y, Pointf* out)
+//attributes of a spawned particle which take a random number
+enum SpawnRandom
 {
-    float n = x * x + y * y;
-    // Already normalized.
-    if (n == 1.0f)
-    {
-        return;
-    }
+    RANDOM_LIFE,
+    RANDOM_POS_X,
+    RANDOM_POS_Y,
+    RANDOM_COLOR_R,
+    RANDOM_COLOR_G,
+    RANDOM_COLOR_B,
+    RANDOM_COLOR_A,
+    RANDOM_END_COLOR_R,
+    RANDOM_END_COLOR_G,
+    RANDOM_END_COLOR_B,
+    RANDOM_END_COLOR_A,
+    RANDOM_SIZE,
+    RANDOM_END_SIZE,
+    RANDOM_SPIN,
+    RANDOM_END_SPIN,
+    RANDOM_RADIAL_ACCEL,
+    RANDOM_TANGENTIAL_ACCEL,
+    RANDOM_ANGLE,
+    RANDOM_SPEED,
+    RANDOM_RADIUS,
+    RANDOM_ROTATE_PER_SECOND,
+    RANDOM_END_RADIUS,
+    RANDOM_FRAME,
+    RANDOM_COUNT,
+};
+
+//the key of an attribute of a system, a random number is then one hash of the key and the serial of the particle
+inline static uint32_t randomKey(uint32_t seed, int attribute)
+{
+    return ParticleKernels::hash32(seed ^ ParticleKernels::hash32(uint32_t(attribute) * 0x9e3779b9u));
+}
 
-    n = sqrt(n);
-    // Too close to zero.
-    if (n < 1e-5)
+void ParticleData::resize(int count, int keep)
+{
+    const int align = 16;    //floats, 64 bytes
+    int stride = (count + align - 1) / align * align;
+    int streams = 0;
+    forEachStream([&](float*&) { streams++; });
+
+    std::vector<float> buffer(size_t(stride) * streams + align);
+    std::vector<unsigned int> atlas_buffer(stride);
+    float* s = buffer.data();
+    s += (align - (uintptr_t(s) / sizeof(float)) % align) % align;
+    keep = (std::min)(keep, (std::min)(count, max_count_));
+    forEachStream([&](float*& p)
+        {
+            if (keep > 0)
+            {
+                std::copy(p, p + keep, s);
+            }
+            p = s;
+            s += stride;
+        });
+    if (keep > 0)
     {
-        return;
+        std::copy(atlasIndex, atlasIndex + keep, atlas_buffer.data());
     }
+    atlasIndex = atlas_buffer.data();
 
-    n = 1.0f / n;
-    out->x = x * n;
-    out->y = y * n;
+    buffer_.swap(buffer);
+    atlas_buffer_.swap(atlas_buffer);
+    max_count_ = count;
 }
 
-/**
-A more effect random number getter function, get from ejoy2d.
-*/
-inline static float RANDOM_M11(unsigned int* seed)
+void ParticleData::copyRenderStreams(const ParticleData& src, int count)
 {
-    *seed = *seed * 134775813 + 1;
-    union
+    if (max_count_ < count)
     {
-        uint32_t d;
-        float f;
-    } u;
-    u.d = (((uint32_t)(*seed) & 0x7fff) << 8) | 0x40000000;
-    return u.f - 3.0f;
+        resize(src.max_count_, 0);
+    }
+    auto copy = [count](const float* from, float* to) { std::copy(from, from + count, to); };
+    copy(src.posx, posx);
+    copy(src.posy, posy);
+    copy(src.prevPosX, prevPosX);
+    copy(src.prevPosY, prevPosY);
+    copy(src.startPosX, startPosX);
+    copy(src.startPosY, startPosY);
+    copy(src.colorR, colorR);
+    copy(src.colorG, colorG);
+    copy(src.colorB, colorB);
+    copy(src.colorA, colorA);
+    copy(src.deltaColorR, deltaColorR);
+    copy(src.deltaColorG, deltaColorG);
+    copy(src.deltaColorB, deltaColorB);
+    copy(src.deltaColorA, deltaColorA);
+    copy(src.size, size);
+    copy(src.deltaSize, deltaSize);
+    copy(src.rotation, rotation);
+    copy(src.deltaRotation, deltaRotation);
+    copy(src.timeToLive, timeToLive);
+    copy(src.lifeSpan, lifeSpan);
+    std::copy(src.atlasIndex, src.atlasIndex + count, atlasIndex);
 }
 
 ParticleSystem::ParticleSystem()
 {
+    _seed = rand();
+    ParticleBudget::getInstance().add(this);
 }
 
 // implementation ParticleSystem
@@ -79,66 +147,73 @@ bool ParticleSystem::initWithTotalParticles(int numberOfParticles)
 
 void ParticleSystem::resetTotalParticles(int numberOfParticles)
 {
-    if (particle_data_.size() < numberOfParticles)
+    if (particle_data_.getMaxCount() < numberOfParticles)
     {
-        particle_data_.resize(numberOfParticles);
+        particle_data_.resize(numberOfParticles, _particleCount);
     }
 }
 
 ParticleSystem::~ParticleSystem()
 {
+    stopSimulationThread();
+    ParticleBudget::getInstance().remove(this);
 }
 
 void ParticleSystem::addParticles(int count)
 {
-    if (_paused)
+    if (_paused || count <= 0)
     {
         return;
     }
-    uint32_t RANDSEED = rand();
-
     int start = _particleCount;
     _particleCount += count;
-
-    //life
-    for (int i = start; i < _particleCount; ++i)
+    //the features are of the particles alive, those of the dead ones are dropped when the system is empty
+    _features = (start == 0 ? 0 : _features) | getSpawnFeatures();
+    uint32_t serial = _spawnSerial;
+    _spawnSerial += count;
+    uint32_t keys[RANDOM_COUNT];
+    for (int a = 0; a < RANDOM_COUNT; a++)
     {
-        float theLife = _life + _lifeVar * RANDOM_M11(&RANDSEED);
-        particle_data_[i].timeToLive = (std::max)(0.0f, theLife);
+        keys[a] = randomKey(_seed, a);
     }
+    //the random attributes are made by the spawn kernel, a batch at once
+#define RANDOM(out, attribute, base, var, scale, lo, hi) ParticleKernels::spawnRandom(out, count, keys[attribute], serial, base, var, scale, lo, hi)
+    _spawnScratch.resize(size_t(count) * 3);
+    float* scratch0 = _spawnScratch.data();
+    float* scratch1 = scratch0 + count;
+    float* scratch2 = scratch1 + count;
+
+    //life
+    RANDOM(particle_data_.timeToLive + start, RANDOM_LIFE, _life, _lifeVar, 1, 0, FLT_MAX);
+    std::copy(particle_data_.timeToLive + start, particle_data_.timeToLive + _particleCount, particle_data_.lifeSpan + start);
 
     //position
-    for (int i = start; i < _particleCount; ++i)
-    {
-        particle_data_[i].posx = _sourcePosition.x + _posVar.x * RANDOM_M11(&RANDSEED);
-    }
+    RANDOM(particle_data_.posx + start, RANDOM_POS_X, _sourcePosition.x, _posVar.x, 1, -FLT_MAX, FLT_MAX);
+    RANDOM(particle_data_.posy + start, RANDOM_POS_Y, _sourcePosition.y, _posVar.y, 1, -FLT_MAX, FLT_MAX);
 
-    for (int i = start; i < _particleCount; ++i)
+    if (_isInterpolated)
     {
-        particle_data_[i].posy = _sourcePosition.y + _posVar.y * RANDOM_M11(&RANDSEED);
+        std::copy(particle_data_.posx + start, particle_data_.posx + _particleCount, particle_data_.prevPosX + start);
+        std::copy(particle_data_.posy + start, particle_data_.posy + _particleCount, particle_data_.prevPosY + start);
     }
 
     //color
-#define SET_COLOR(c, b, v)                                                 \
-    for (int i = start; i < _particleCount; ++i)                           \
-    {                                                                      \
-        particle_data_[i].c = clampf(b + v * RANDOM_M11(&RANDSEED), 0, 1); \
-    }
+#define SET_COLOR(c, b, v, r) RANDOM(particle_data_.c + start, r, b, v, 1, 0, 1)
 
-    SET_COLOR(colorR, _startColor.r, _startColorVar.r);
-    SET_COLOR(colorG, _startColor.g, _startColorVar.g);
-    SET_COLOR(colorB, _startColor.b, _startColorVar.b);
-    SET_COLOR(colorA, _startColor.a, _startColorVar.a);
+    SET_COLOR(colorR, _startColor.r, _startColorVar.r, RANDOM_COLOR_R);
+    SET_COLOR(colorG, _startColor.g, _startColorVar.g, RANDOM_COLOR_G);
+    SET_COLOR(colorB, _startColor.b, _startColorVar.b, RANDOM_COLOR_B);
+    SET_COLOR(colorA, _startColor.a, _startColorVar.a, RANDOM_COLOR_A);
 
-    SET_COLOR(deltaColorR, _endColor.r, _endColorVar.r);
-    SET_COLOR(deltaColorG, _endColor.g, _endColorVar.g);
-    SET_COLOR(deltaColorB, _endColor.b, _endColorVar.b);
-    SET_COLOR(deltaColorA, _endColor.a, _endColorVar.a);
+    SET_COLOR(deltaColorR, _endColor.r, _endColorVar.r, RANDOM_END_COLOR_R);
+    SET_COLOR(deltaColorG, _endColor.g, _endColorVar.g, RANDOM_END_COLOR_G);
+    SET_COLOR(deltaColorB, _endColor.b, _endColorVar.b, RANDOM_END_COLOR_B);
+    SET_COLOR(deltaColorA, _endColor.a, _endColorVar.a, RANDOM_END_COLOR_A);
 
 #define SET_DELTA_COLOR(c, dc)                                                                              \
     for (int i = start; i < _particleCount; ++i)                                                            \
     {                                                                                                       \
-        particle_data_[i].dc = (particle_data_[i].dc - particle_data_[i].c) / particle_data_[i].timeToLive; \
+        particle_data_.dc[i] = (particle_data_.dc[i] - particle_data_.c[i]) / particle_data_.timeToLive[i]; \
     }
 
     SET_DELTA_COLOR(colorR, deltaColorR);
@@ -147,38 +222,38 @@ void ParticleSystem::addParticles(int count)
     SET_DELTA_COLOR(colorA, deltaColorA);
 
     //size
-    for (int i = start; i < _particleCount; ++i)
-    {
-        particle_data_[i].size = _startSize + _startSizeVar * RANDOM_M11(&RANDSEED);
-        particle_data_[i].size = (std::max)(0.0f, particle_data_[i].size);
-    }
+    RANDOM(particle_data_.size + start, RANDOM_SIZE, _startSize, _startSizeVar, 1, 0, FLT_MAX);
 
     if (_endSize != START_SIZE_EQUAL_TO_END_SIZE)
     {
+        RANDOM(scratch0, RANDOM_END_SIZE, _endSize, _endSizeVar, 1, 0, FLT_MAX);
         for (int i = start; i < _particleCount; ++i)
         {
-            float endSize = _endSize + _endSizeVar * RANDOM_M11(&RANDSEED);
-            endSize = (std::max)(0.0f, endSize);
-            particle_data_[i].deltaSize = (endSize - particle_data_[i].size) / particle_data_[i].timeToLive;
+            particle_data_.deltaSize[i] = (scratch0[i - start] - particle_data_.size[i]) / particle_data_.timeToLive[i];
         }
     }
     else
     {
         for (int i = start; i < _particleCount; ++i)
         {
-            particle_data_[i].deltaSize = 0.0f;
+            particle_data_.deltaSize[i] = 0.0f;
         }
     }
-
-    // rotation
-    for (int i = start; i < _particleCount; ++i)
+    if (_isStatelessAttributes)
     {
-        particle_data_[i].rotation = _startSpin + _startSpinVar * RANDOM_M11(&RANDSEED);
+        //the bounds take the size stream, so it holds the largest size of the life
+        for (int i = start; i < _particleCount; ++i)
+        {
+            particle_data_.size[i] += (std::max)(0.0f, particle_data_.deltaSize[i]) * particle_data_.lifeSpan[i];
+        }
     }
+
+    // rotation
+    RANDOM(particle_data_.rotation + start, RANDOM_SPIN, _startSpin, _startSpinVar, 1, -FLT_MAX, FLT_MAX);
+    RANDOM(scratch0, RANDOM_END_SPIN, _endSpin, _endSpinVar, 1, -FLT_MAX, FLT_MAX);
     for (int i = start; i < _particleCount; ++i)
     {
-        float endA = _endSpin + _endSpinVar * RANDOM_M11(&RANDSEED);
-        particle_data_[i].deltaRotation = (endA - particle_data_[i].rotation) / particle_data_[i].timeToLive;
+        particle_data_.deltaRotation[i] = (scratch0[i - start] - particle_data_.rotation[i]) / particle_data_.timeToLive[i];
     }
 
     // position
@@ -188,11 +263,11 @@ void ParticleSystem::addParticles(int count)
 
     for (int i = start; i < _particleCount; ++i)
     {
-        particle_data_[i].startPosX = pos.x;
+        particle_data_.startPosX[i] = pos.x;
     }
     for (int i = start; i < _particleCount; ++i)
     {
-        particle_data_[i].startPosY = pos.y;
+        particle_data_.startPosY[i] = pos.y;
     }
 
     // Mode Gravity: A
@@ -200,15 +275,19 @@ void ParticleSystem::addParticles(int count)
     {
 
         // radial accel
-        for (int i = start; i < _particleCount; ++i)
-        {
-            particle_data_[i].modeA.radialAccel = modeA.radialAccel + modeA.radialAccelVar * RANDOM_M11(&RANDSEED);
-        }
+        RANDOM(particle_data_.modeA.radialAccel + start, RANDOM_RADIAL_ACCEL, modeA.radialAccel, modeA.radialAccelVar, 1, -FLT_MAX, FLT_MAX);
 
         // tangential accel
+        RANDOM(particle_data_.modeA.tangentialAccel + start, RANDOM_TANGENTIAL_ACCEL, modeA.tangentialAccel, modeA.tangentialAccelVar, 1, -FLT_MAX, FLT_MAX);
+
+        // direction, the sin/cos of the angles in bulk
+        RANDOM(scratch0, RANDOM_ANGLE, _angle, _angleVar, Deg2Rad(1), -FLT_MAX, FLT_MAX);
+        ParticleKernels::sinCos(scratch0, scratch1, scratch2, count, _trigPrecision);
+        RANDOM(scratch0, RANDOM_SPEED, modeA.speed, modeA.speedVar, 1, -FLT_MAX, FLT_MAX);
         for (int i = start; i < _particleCount; ++i)
         {
-            particle_data_[i].modeA.tangentialAccel = modeA.tangentialAccel + modeA.tangentialAccelVar * RANDOM_M11(&RANDSEED);
+            particle_data_.modeA.dirX[i] = scratch2[i - start] * scratch0[i - start];
+            particle_data_.modeA.dirY[i] = scratch1[i - start] * scratch0[i - start];
         }
 
         // rotation is dir
@@ -216,25 +295,8 @@ void ParticleSystem::addParticles(int count)
         {
             for (int i = start; i < _particleCount; ++i)
             {
-                float a = Deg2Rad(_angle + _angleVar * RANDOM_M11(&RANDSEED));
-                Vec2 v(cosf(a), sinf(a));
-                float s = modeA.speed + modeA.speedVar * RANDOM_M11(&RANDSEED);
-                Vec2 dir = v * s;
-                particle_data_[i].modeA.dirX = dir.x;    //v * s ;
-                particle_data_[i].modeA.dirY = dir.y;
-                particle_data_[i].rotation = -Rad2Deg(dir.getAngle());
-            }
-        }
-        else
-        {
-            for (int i = start; i < _particleCount; ++i)
-            {
-                float a = Deg2Rad(_angle + _angleVar * RANDOM_M11(&RANDSEED));
-                Vec2 v(cosf(a), sinf(a));
-                float s = modeA.speed + modeA.speedVar * RANDOM_M11(&RANDSEED);
-                Vec2 dir = v * s;
-                particle_data_[i].modeA.dirX = dir.x;    //v * s ;
-                particle_data_[i].modeA.dirY = dir.y;
+                Vec2 dir(particle_data_.modeA.dirX[i], particle_data_.modeA.dirY[i]);
+                particle_data_.rotation[i] = -Rad2Deg(dir.getAngle());
             }
         }
     }
@@ -242,37 +304,51 @@ void ParticleSystem::addParticles(int count)
     // Mode Radius: B
     else
     {
-        for (int i = start; i < _particleCount; ++i)
-        {
-            particle_data_[i].modeB.radius = modeB.startRadius + modeB.startRadiusVar * RANDOM_M11(&RANDSEED);
-        }
-
-        for (int i = start; i < _particleCount; ++i)
-        {
-            particle_data_[i].modeB.angle = Deg2Rad(_angle + _angleVar * RANDOM_M11(&RANDSEED));
-        }
-
-        for (int i = start; i < _particleCount; ++i)
-        {
-            particle_data_[i].modeB.degreesPerSecond = Deg2Rad(modeB.rotatePerSecond + modeB.rotatePerSecondVar * RANDOM_M11(&RANDSEED));
-        }
+        RANDOM(particle_data_.modeB.radius + start, RANDOM_RADIUS, modeB.startRadius, modeB.startRadiusVar, 1, -FLT_MAX, FLT_MAX);
+        RANDOM(particle_data_.modeB.angle + start, RANDOM_ANGLE, _angle, _angleVar, Deg2Rad(1), -FLT_MAX, FLT_MAX);
+        RANDOM(particle_data_.modeB.degreesPerSecond + start, RANDOM_ROTATE_PER_SECOND, modeB.rotatePerSecond, modeB.rotatePerSecondVar, Deg2Rad(1), -FLT_MAX, FLT_MAX);
 
         if (modeB.endRadius == START_RADIUS_EQUAL_TO_END_RADIUS)
         {
             for (int i = start; i < _particleCount; ++i)
             {
-                particle_data_[i].modeB.deltaRadius = 0.0f;
+                particle_data_.modeB.deltaRadius[i] = 0.0f;
             }
         }
         else
         {
+            RANDOM(scratch0, RANDOM_END_RADIUS, modeB.endRadius, modeB.endRadiusVar, 1, -FLT_MAX, FLT_MAX);
             for (int i = start; i < _particleCount; ++i)
             {
-                float endRadius = modeB.endRadius + modeB.endRadiusVar * RANDOM_M11(&RANDSEED);
-                particle_data_[i].modeB.deltaRadius = (endRadius - particle_data_[i].modeB.radius) / particle_data_[i].timeToLive;
+                particle_data_.modeB.deltaRadius[i] = (scratch0[i - start] - particle_data_.modeB.radius[i]) / particle_data_.timeToLive[i];
             }
         }
     }
+
+    // atlas frame
+    if (_atlas && _atlasFrameCount > 1)
+    {
+        float half = 0.5f * _atlasFrameCount;
+        RANDOM(scratch0, RANDOM_FRAME, half, half, 1, 0, float(_atlasFrameCount - 1));
+        for (int i = start; i < _particleCount; ++i)
+        {
+            particle_data_.atlasIndex[i] = _atlasIndex + int(scratch0[i - start]);
+        }
+    }
+    else
+    {
+        for (int i = start; i < _particleCount; ++i)
+        {
+            particle_data_.atlasIndex[i] = _atlasIndex;
+        }
+    }
+#undef RANDOM
+
+    //the new particles are drawn before the next step
+    ParticleBounds bounds;
+    ParticleKernels::accumulateBounds(particle_data_, start, _particleCount, bounds);
+    _stepBounds.merge(bounds);
+    _bounds.merge(bounds);
 }
 
 void ParticleSystem::stopSystem()
@@ -288,7 +364,7 @@ void ParticleSystem::resetSystem()
     _elapsed = 0;
     for (int i = 0; i < _particleCount; ++i)
     {
-        //particle_data_[i].timeToLive = 0.0f;
+        //particle_data_.timeToLive[i] = 0.0f;
     }
 }
 
@@ -300,11 +376,341 @@ bool ParticleSystem::isFull()
 // ParticleSystem - MainLoop
 void ParticleSystem::update()
 {
-    float dt = 1.0 / 25;
+    update(1.0f / 25);
+}
+
+void ParticleSystem::update(float dt)
+{
+    float step;
+    int steps = prepareSteps(dt, step);
+    for (int i = 0; i < steps; ++i)
+    {
+        simulate(step);
+    }
+}
+
+int ParticleSystem::prepareSteps(float dt, float& step)
+{
+    step = 0;
+    if (dt <= 0)
+    {
+        return 0;
+    }
+    auto activity = getEffectiveActivity();
+    if (activity == Activity::FROZEN)
+    {
+        _sleepTime += dt;
+        return 0;
+    }
+    if (activity == Activity::REDUCED)
+    {
+        _sleepTime += dt;
+        if (_sleepTime < _reducedTimeStep)
+        {
+            return 0;
+        }
+        //a long sleep before (e.g. frozen) is caught up at once, not by one long step
+        if (_sleepTime > 2 * _reducedTimeStep)
+        {
+            fastForward(_sleepTime - _reducedTimeStep);
+            _sleepTime = _reducedTimeStep;
+        }
+        step = _sleepTime;
+        _sleepTime = 0;
+        return 1;
+    }
+    if (_sleepTime > 0)
+    {
+        fastForward(_sleepTime);
+        _sleepTime = 0;
+    }
+    if (_fixedTimeStep <= 0)
+    {
+        step = dt;
+        return 1;
+    }
+    _timeAccumulator += dt;
+    int steps = int(_timeAccumulator / _fixedTimeStep);
+    if (steps > _maxSubSteps)
+    {
+        //too far behind, drop the time which cannot be caught up
+        steps = _maxSubSteps;
+        _timeAccumulator = steps * _fixedTimeStep;
+    }
+    _timeAccumulator -= steps * _fixedTimeStep;
+    step = _fixedTimeStep;
+    return steps;
+}
+
+//the steps of fastForward() where the motion has no closed form, short enough that the acceleration changes the
+//velocity by about 1 pixel per second in a step
+static float coarseStep(float acceleration)
+{
+    const float min_step = 0.1f, max_step = 1.0f;
+    return acceleration > 1 ? (std::max)(min_step, 1 / acceleration) : max_step;
+}
+
+//the fraction of the particles born at an even pace with ages in [youngest, oldest] which are still alive, the life
+//is uniform in life +- lifeVar
+static float survivalFraction(float life, float lifeVar, float youngest, float oldest)
+{
+    const int samples = 32;
+    float lo = life - fabsf(lifeVar), hi = life + fabsf(lifeVar);
+    float alive = 0;
+    for (int k = 0; k < samples; k++)
+    {
+        float age = youngest + (oldest - youngest) * (k + 0.5f) / samples;
+        alive += hi > lo ? clampf((hi - age) / (hi - lo), 0, 1) : float(age < hi);
+    }
+    return alive / samples;
+}
+
+void ParticleSystem::prewarm(float seconds)
+{
+    if (seconds < 0)
+    {
+        seconds = _life + fabsf(_lifeVar);
+    }
+    float elapsed = _elapsed;
+    bool active = _isActive;
+    fastForward(seconds);
+    _elapsed = elapsed;
+    _isActive = active;
+}
+
+void ParticleSystem::fastForward(float seconds)
+{
+    if (seconds <= 0)
+    {
+        return;
+    }
+    if (_emitterMode == Mode::GRAVITY && (modeA.radialAccel != 0 || modeA.radialAccelVar != 0 || modeA.tangentialAccel != 0 || modeA.tangentialAccelVar != 0))
+    {
+        fastForwardSteps(seconds);
+        return;
+    }
+    for (int i = 0; i < _particleCount; ++i)
+    {
+        advanceParticle(i, seconds);
+    }
+    _deadParticleCount = compactParticles();
+
+    //emission: the particles born at t in [0, seconds] are seconds - t old at the end, only those younger than the
+    //longest life can still be alive
+    float emissionRate = getEffectiveEmissionRate();
     if (_isActive && _emissionRate)
     {
-        float rate = 1.0f / _emissionRate;
-        int totalParticles = _totalParticles;
+        float active = seconds;
+        if (_duration != DURATION_INFINITY)
+        {
+            active = clampf(_duration - _elapsed, 0, seconds);
+        }
+        float oldest = (std::min)(seconds, _life + fabsf(_lifeVar));
+        float youngest = seconds - active;
+        int births = emissionRate > 0 && oldest > youngest ? int((oldest - youngest) * emissionRate) : 0;
+        //a full system emits only when particles die, so the births are spread over the whole period at the pace
+        //which leaves about as many alive at the end as the room after the particles alive before
+        int room = getEffectiveTotalParticles() - _particleCount;
+        float survivors = births * survivalFraction(_life, _lifeVar, youngest, oldest);
+        if (survivors > room)
+        {
+            births = int(births * (std::max)(0, room) / survivors);
+        }
+        //evenly spread ages from the oldest, like a steady emission; each batch fills the room left by the dead ones
+        for (int born = 0; born < births;)
+        {
+            int count = (std::min)(births - born, getEffectiveTotalParticles() - _particleCount);
+            if (count <= 0)
+            {
+                break;
+            }
+            int start = _particleCount;
+            addParticles(count);
+            for (int i = start; i < _particleCount; ++i)
+            {
+                advanceParticle(i, oldest - (oldest - youngest) * (born + i - start + 0.5f) / births);
+            }
+            born += count;
+            _deadParticleCount += compactParticles();
+        }
+        _emitCounter = 0;
+
+        //like emit(), the duration runs even when the budget stops the emission
+        _elapsed += seconds;
+        if (_duration != DURATION_INFINITY && _duration < _elapsed)
+        {
+            this->stopSystem();
+        }
+    }
+
+    _stepBounds = ParticleBounds();
+    ParticleKernels::accumulateBounds(particle_data_, 0, _particleCount, _stepBounds);
+    _bounds = _stepBounds;
+}
+
+void ParticleSystem::advanceParticle(int i, float t)
+{
+    auto& p = particle_data_;
+    p.timeToLive[i] -= t;
+    if (p.timeToLive[i] <= 0)
+    {
+        return;
+    }
+    if (!_isStatelessAttributes)
+    {
+        p.colorR[i] += p.deltaColorR[i] * t;
+        p.colorG[i] += p.deltaColorG[i] * t;
+        p.colorB[i] += p.deltaColorB[i] * t;
+        p.colorA[i] += p.deltaColorA[i] * t;
+        p.size[i] = (std::max)(0.0f, p.size[i] + p.deltaSize[i] * t);
+        p.rotation[i] += p.deltaRotation[i] * t;
+    }
+
+    float yFlip = float(_yCoordFlipped);
+    if (_emitterMode == Mode::GRAVITY)
+    {
+        if (p.modeA.radialAccel[i] == 0 && p.modeA.tangentialAccel[i] == 0)
+        {
+            //constant acceleration
+            p.posx[i] += (p.modeA.dirX[i] + 0.5f * modeA.gravity.x * t) * t * yFlip;
+            p.posy[i] += (p.modeA.dirY[i] + 0.5f * modeA.gravity.y * t) * t * yFlip;
+            p.modeA.dirX[i] += modeA.gravity.x * t;
+            p.modeA.dirY[i] += modeA.gravity.y * t;
+        }
+        else
+        {
+            //the acceleration depends on the position, coarse steps of the same integration as updateGravity
+            float acceleration = fabsf(modeA.gravity.x) + fabsf(modeA.gravity.y) + fabsf(p.modeA.radialAccel[i]) + fabsf(p.modeA.tangentialAccel[i]);
+            int steps = int(ceilf(t / coarseStep(acceleration)));
+            float dt = t / steps;
+            for (int k = 0; k < steps; k++)
+            {
+                ParticleKernels::updateGravity(p, i, i + 1, dt, modeA.gravity, yFlip);
+            }
+        }
+    }
+    else
+    {
+        p.modeB.angle[i] += p.modeB.degreesPerSecond[i] * t;
+        p.modeB.radius[i] += p.modeB.deltaRadius[i] * t;
+        p.posx[i] = -cosf(p.modeB.angle[i]) * p.modeB.radius[i];
+        p.posy[i] = -sinf(p.modeB.angle[i]) * p.modeB.radius[i] * yFlip;
+    }
+    if (_isInterpolated)
+    {
+        p.prevPosX[i] = p.posx[i];
+        p.prevPosY[i] = p.posy[i];
+    }
+}
+
+void ParticleSystem::fastForwardSteps(float seconds)
+{
+    float acceleration = fabsf(modeA.gravity.x) + fabsf(modeA.gravity.y) + fabsf(modeA.radialAccel) + fabsf(modeA.radialAccelVar)
+        + fabsf(modeA.tangentialAccel) + fabsf(modeA.tangentialAccelVar);
+    int steps = int(ceilf(seconds / coarseStep(acceleration)));
+    float dt = seconds / steps;
+    float lastStepDt = _lastStepDt;
+    int dead = 0;
+    for (int k = 0; k < steps; k++)
+    {
+        int start = _particleCount;
+        emit(dt);
+        ParticleBounds bounds;
+        integrate(0, start, dt, bounds);
+        //the particles emitted in a step are born over it, not all at its start
+        int born = _particleCount - start;
+        for (int i = start; i < _particleCount; ++i)
+        {
+            advanceParticle(i, dt * (i - start + 0.5f) / born);
+        }
+        ParticleKernels::accumulateBounds(particle_data_, start, _particleCount, bounds);
+        compact(bounds);
+        dead += _deadParticleCount;
+    }
+    _deadParticleCount = dead;
+    //there is nothing to interpolate from
+    _lastStepDt = lastStepDt;
+    if (_isInterpolated)
+    {
+        std::copy(particle_data_.posx, particle_data_.posx + _particleCount, particle_data_.prevPosX);
+        std::copy(particle_data_.posy, particle_data_.posy + _particleCount, particle_data_.prevPosY);
+    }
+    _stepBounds = ParticleBounds();
+    ParticleKernels::accumulateBounds(particle_data_, 0, _particleCount, _stepBounds);
+    _bounds = _stepBounds;
+}
+
+void ParticleSystem::setInterpolated(bool interpolated)
+{
+    if (interpolated && !_isInterpolated)
+    {
+        std::copy(particle_data_.posx, particle_data_.posx + _particleCount, particle_data_.prevPosX);
+        std::copy(particle_data_.posy, particle_data_.posy + _particleCount, particle_data_.prevPosY);
+    }
+    _isInterpolated = interpolated;
+}
+
+void ParticleSystem::setStatelessAttributes(bool stateless)
+{
+    if (stateless == _isStatelessAttributes)
+    {
+        return;
+    }
+    //move the particles alive between their values now and at the birth
+    auto& p = particle_data_;
+    for (int i = 0; i < _particleCount; ++i)
+    {
+        float age = p.lifeSpan[i] - p.timeToLive[i];
+        float t = stateless ? -age : age;
+        float largest = (std::max)(0.0f, p.deltaSize[i]) * p.lifeSpan[i];
+        p.colorR[i] += p.deltaColorR[i] * t;
+        p.colorG[i] += p.deltaColorG[i] * t;
+        p.colorB[i] += p.deltaColorB[i] * t;
+        p.colorA[i] += p.deltaColorA[i] * t;
+        p.rotation[i] += p.deltaRotation[i] * t;
+        if (stateless)
+        {
+            p.size[i] += p.deltaSize[i] * t + largest;
+        }
+        else
+        {
+            p.size[i] = (std::max)(0.0f, p.size[i] - largest + p.deltaSize[i] * t);
+        }
+    }
+    _isStatelessAttributes = stateless;
+}
+
+void ParticleSystem::setFixedTimeStep(float step, int maxSubSteps)
+{
+    _fixedTimeStep = step;
+    _maxSubSteps = (std::max)(1, maxSubSteps);
+    _timeAccumulator = 0;
+}
+
+void ParticleSystem::simulate(float dt)
+{
+    emit(dt);
+    ParticleBounds bounds;
+    if (_updatePath == UpdatePath::FUSED)
+    {
+        updateFused(dt, bounds);
+    }
+    else
+    {
+        updateMultiPass(dt, bounds);
+    }
+    finishStep(bounds);
+}
+
+void ParticleSystem::emit(float dt)
+{
+    _lastStepDt = dt;
+    //a system out of budget emits nothing, but its duration still runs
+    float emissionRate = getEffectiveEmissionRate();
+    if (_isActive && _emissionRate)
+    {
+        float rate = emissionRate > 0 ? 1.0f / emissionRate : FLT_MAX;
+        int totalParticles = getEffectiveTotalParticles();
 
         //issue #1201, prevent bursts of particles, due to too high emitCounter
         if (_particleCount < totalParticles)
@@ -316,7 +722,8 @@ void ParticleSystem::update()
             }
         }
 
-        int emitCount = (std::min)(1.0f * (totalParticles - _particleCount), _emitCounter / rate);
+        //the budget may have scaled the total below the particles alive
+        int emitCount = (std::max)(0, int((std::min)(1.0f * (totalParticles - _particleCount), _emitCounter / rate)));
         addParticles(emitCount);
         _emitCounter -= rate * emitCount;
 
@@ -330,88 +737,209 @@ void ParticleSystem::update()
             this->stopSystem();
         }
     }
+}
 
-    for (int i = 0; i < _particleCount; ++i)
+void ParticleSystem::integrate(int begin, int end, float dt, ParticleBounds& bounds)
+{
+    for (int i = begin; i < end; ++i)
     {
-        particle_data_[i].timeToLive -= dt;
+        particle_data_.timeToLive[i] -= dt;
     }
+    updateMotion(begin, end, dt);
+    updateColorSizeRotation(begin, end, dt);
+    ParticleKernels::accumulateBounds(particle_data_, begin, end, bounds);
+}
 
-    // rebirth
+void ParticleSystem::compact(const ParticleBounds& bounds)
+{
+    //the order is kept, like the fused update
+    int alive = 0;
     for (int i = 0; i < _particleCount; ++i)
     {
-        if (particle_data_[i].timeToLive <= 0.0f)
+        if (particle_data_.timeToLive[i] > 0.0f)
         {
-            int j = _particleCount - 1;
-            //while (j > 0 && particle_data_[i].timeToLive <= 0)
-            //{
-            //    _particleCount--;
-            //    j--;
-            //}
-            particle_data_[i] = particle_data_[_particleCount - 1];
-            --_particleCount;
+            if (alive != i)
+            {
+                particle_data_.copyParticle(alive, i);
+            }
+            alive++;
         }
     }
+    _deadParticleCount = _particleCount - alive;
+    _particleCount = alive;
+    finishStep(bounds);
+}
 
-    if (_emitterMode == Mode::GRAVITY)
+void ParticleSystem::finishStep(const ParticleBounds& bounds)
+{
+    //the interpolated particles are between the last two steps
+    ParticleBounds previous = _stepBounds;
+    _stepBounds = bounds;
+    _bounds = bounds;
+    if (_isInterpolated)
     {
-        for (int i = 0; i < _particleCount; ++i)
-        {
-            Pointf tmp, radial = { 0.0f, 0.0f }, tangential;
+        _bounds.merge(previous);
+    }
+}
 
-            // radial acceleration
-            if (particle_data_[i].posx || particle_data_[i].posy)
-            {
-                normalize_point(particle_data_[i].posx, particle_data_[i].posy, &radial);
-            }
-            tangential = radial;
-            radial.x *= particle_data_[i].modeA.radialAccel;
-            radial.y *= particle_data_[i].modeA.radialAccel;
+void ParticleSystem::updateMultiPass(float dt, ParticleBounds& bounds)
+{
+    for (int i = 0; i < _particleCount; ++i)
+    {
+        particle_data_.timeToLive[i] -= dt;
+    }
 
-            // tangential acceleration
-            std::swap(tangential.x, tangential.y);
-            tangential.x *= -particle_data_[i].modeA.tangentialAccel;
-            tangential.y *= particle_data_[i].modeA.tangentialAccel;
+    // rebirth
+    _deadParticleCount = compactParticles();
 
-            // (gravity + radial + tangential) * dt
-            tmp.x = radial.x + tangential.x + modeA.gravity.x;
-            tmp.y = radial.y + tangential.y + modeA.gravity.y;
-            tmp.x *= dt;
-            tmp.y *= dt;
+    updateMotion(0, _particleCount, dt);
+    updateColorSizeRotation(0, _particleCount, dt);
+    ParticleKernels::accumulateBounds(particle_data_, 0, _particleCount, bounds);
+}
 
-            particle_data_[i].modeA.dirX += tmp.x;
-            particle_data_[i].modeA.dirY += tmp.y;
+void ParticleSystem::updateFused(float dt, ParticleBounds& bounds)
+{
+    //blocks small enough that all the streams of a block stay in L1 between the stages
+    int alive = 0;
+    for (int begin = 0; begin < _particleCount; begin += FUSED_BLOCK)
+    {
+        int end = (std::min)(begin + FUSED_BLOCK, _particleCount);
+        integrate(begin, end, dt, bounds);
 
-            // this is cocos2d-x v3.0
-            // if (_configName.length()>0 && _yCoordFlipped != -1)
+        //move the living ones to the front, the order is kept
+        for (int i = begin; i < end; ++i)
+        {
+            if (particle_data_.timeToLive[i] > 0.0f)
+            {
+                if (alive != i)
+                {
+                    particle_data_.copyParticle(alive, i);
+                }
+                alive++;
+            }
+        }
+    }
+    _deadParticleCount = _particleCount - alive;
+    _particleCount = alive;
+}
 
-            // this is cocos2d-x v3.0
-            tmp.x = particle_data_[i].modeA.dirX * dt * _yCoordFlipped;
-            tmp.y = particle_data_[i].modeA.dirY * dt * _yCoordFlipped;
-            particle_data_[i].posx += tmp.x;
-            particle_data_[i].posy += tmp.y;
+int ParticleSystem::compactParticles()
+{
+    //two pointers: a dead particle is replaced by the last living one, the dead ones at the end are dropped on the way
+    int count = _particleCount;
+    int i = 0;
+    while (i < count)
+    {
+        if (particle_data_.timeToLive[i] > 0.0f)
+        {
+            i++;
+            continue;
+        }
+        count--;
+        while (count > i && particle_data_.timeToLive[count] <= 0.0f)
+        {
+            count--;
+        }
+        if (count > i)
+        {
+            particle_data_.copyParticle(i, count);
+            i++;
         }
     }
-    else
+    int dead = _particleCount - count;
+    _particleCount = count;
+    return dead;
+}
+
+unsigned int ParticleSystem::getSpawnFeatures() const
+{
+    unsigned int features = 0;
+    if (_emitterMode == Mode::GRAVITY)
     {
-        for (int i = 0; i < _particleCount; ++i)
+        if (modeA.radialAccel != 0 || modeA.radialAccelVar != 0 || modeA.tangentialAccel != 0 || modeA.tangentialAccelVar != 0)
         {
-            particle_data_[i].modeB.angle += particle_data_[i].modeB.degreesPerSecond * dt;
-            particle_data_[i].modeB.radius += particle_data_[i].modeB.deltaRadius * dt;
-            particle_data_[i].posx = -cosf(particle_data_[i].modeB.angle) * particle_data_[i].modeB.radius;
-            particle_data_[i].posy = -sinf(particle_data_[i].modeB.angle) * particle_data_[i].modeB.radius * _yCoordFlipped;
+            features |= ParticleKernels::FEATURE_ACCELERATION;
         }
     }
+    else if (modeB.endRadius != START_RADIUS_EQUAL_TO_END_RADIUS)
+    {
+        features |= ParticleKernels::FEATURE_DELTA_RADIUS;
+    }
+    if (_startColor.r != _endColor.r || _startColor.g != _endColor.g || _startColor.b != _endColor.b || _startColor.a != _endColor.a
+        || _startColorVar.r != 0 || _startColorVar.g != 0 || _startColorVar.b != 0 || _startColorVar.a != 0
+        || _endColorVar.r != 0 || _endColorVar.g != 0 || _endColorVar.b != 0 || _endColorVar.a != 0)
+    {
+        features |= ParticleKernels::FEATURE_DELTA_COLOR;
+    }
+    if (_endSize != START_SIZE_EQUAL_TO_END_SIZE)
+    {
+        features |= ParticleKernels::FEATURE_DELTA_SIZE;
+    }
+    if (_startSpin != _endSpin || _startSpinVar != 0 || _endSpinVar != 0)
+    {
+        features |= ParticleKernels::FEATURE_DELTA_ROTATION;
+    }
+    return features;
+}
 
-    //color, size, rotation
-    for (int i = 0; i < _particleCount; ++i)
+void ParticleSystem::updateMotion(int begin, int end, float dt)
+{
+    if (_isInterpolated)
+    {
+        std::copy(particle_data_.posx + begin, particle_data_.posx + end, particle_data_.prevPosX + begin);
+        std::copy(particle_data_.posy + begin, particle_data_.posy + end, particle_data_.prevPosY + begin);
+    }
+    if (_emitterMode == Mode::GRAVITY)
+    {
+        ParticleKernels::updateGravity(particle_data_, begin, end, dt, modeA.gravity, float(_yCoordFlipped), _features);
+    }
+    else
+    {
+        ParticleKernels::updateRadius(particle_data_, begin, end, dt, float(_yCoordFlipped), _trigPrecision, _features);
+    }
+}
+
+void ParticleSystem::updateColorSizeRotation(int begin, int end, float dt)
+{
+    if (_isStatelessAttributes)
+    {
+        return;
+    }
+    //indexed by DELTA_COLOR | DELTA_SIZE << 1 | DELTA_ROTATION << 2
+    static void (ParticleSystem::*const updates[8])(int, int, float) = {
+        &ParticleSystem::updateColorSizeRotation<false, false, false>,
+        &ParticleSystem::updateColorSizeRotation<true, false, false>,
+        &ParticleSystem::updateColorSizeRotation<false, true, false>,
+        &ParticleSystem::updateColorSizeRotation<true, true, false>,
+        &ParticleSystem::updateColorSizeRotation<false, false, true>,
+        &ParticleSystem::updateColorSizeRotation<true, false, true>,
+        &ParticleSystem::updateColorSizeRotation<false, true, true>,
+        &ParticleSystem::updateColorSizeRotation<true, true, true>,
+    };
+    (this->*updates[(_features / ParticleKernels::FEATURE_DELTA_COLOR) & 7])(begin, end, dt);
+}
+
+template <bool COLOR, bool SIZE, bool ROTATION>
+void ParticleSystem::updateColorSizeRotation(int begin, int end, float dt)
+{
+    for (int i = begin; i < end; ++i)
     {
-        particle_data_[i].colorR += particle_data_[i].deltaColorR * dt;
-        particle_data_[i].colorG += particle_data_[i].deltaColorG * dt;
-        particle_data_[i].colorB += particle_data_[i].deltaColorB * dt;
-        particle_data_[i].colorA += particle_data_[i].deltaColorA * dt;
-        particle_data_[i].size += (particle_data_[i].deltaSize * dt);
-        particle_data_[i].size = (std::max)(0.0f, particle_data_[i].size);
-        particle_data_[i].rotation += particle_data_[i].deltaRotation * dt;
+        if constexpr (COLOR)
+        {
+            particle_data_.colorR[i] += particle_data_.deltaColorR[i] * dt;
+            particle_data_.colorG[i] += particle_data_.deltaColorG[i] * dt;
+            particle_data_.colorB[i] += particle_data_.deltaColorB[i] * dt;
+            particle_data_.colorA[i] += particle_data_.deltaColorA[i] * dt;
+        }
+        if constexpr (SIZE)
+        {
+            particle_data_.size[i] += (particle_data_.deltaSize[i] * dt);
+            particle_data_.size[i] = (std::max)(0.0f, particle_data_.size[i]);
+        }
+        if constexpr (ROTATION)
+        {
+            particle_data_.rotation[i] += particle_data_.deltaRotation[i] * dt;
+        }
     }
 }
 
@@ -424,27 +952,289 @@ void ParticleSystem::setTexture(SDL_Texture* var)
     }
 }
 
+void ParticleSystem::setAtlas(ParticleAtlas* atlas, int firstFrame, int frameCount)
+{
+    _atlas = atlas;
+    _atlasIndex = firstFrame;
+    _atlasFrameCount = (std::max)(1, frameCount);
+    if (atlas)
+    {
+        setTexture(atlas->getTexture());
+    }
+}
+
 void ParticleSystem::draw()
 {
     if (_texture == nullptr)
     {
         return;
     }
-    for (int i = 0; i < _particleCount; i++)
+    prepareDrawData(-1, _isViewportSet ? &_viewport : nullptr);
+    render();
+}
+
+void ParticleSystem::draw(float alpha)
+{
+    if (_texture == nullptr)
+    {
+        return;
+    }
+    prepareDrawData(alpha, _isViewportSet ? &_viewport : nullptr);
+    render();
+}
+
+void ParticleSystem::draw(ParticleRenderQueue& queue, int layer)
+{
+    if (_texture == nullptr)
+    {
+        return;
+    }
+    prepareDrawData(-1, _isViewportSet ? &_viewport : nullptr);
+    queue.add(this, layer);
+}
+
+void ParticleSystem::draw(ParticleSoftwareRenderer& renderer)
+{
+    SDL_Rect surface = { 0, 0, renderer.getSurface() ? renderer.getSurface()->w : 0, renderer.getSurface() ? renderer.getSurface()->h : 0 };
+    prepareDrawData(-1, _isViewportSet ? &_viewport : &surface);
+    renderer.add(this);
+}
+
+void ParticleSystem::setViewport(const SDL_Rect* viewport)
+{
+    _isViewportSet = viewport != nullptr;
+    if (viewport)
+    {
+        _viewport = *viewport;
+    }
+}
+
+ParticleBounds ParticleSystem::getSpawnBounds() const
+{
+    //half of the diagonal of the largest start size, and the start radius around the center in radius mode
+    float extent = (std::max)(0.0f, _startSize + fabsf(_startSizeVar)) * 0.7071068f;
+    if (_emitterMode == Mode::RADIUS)
     {
-        auto& p = particle_data_[i];
-        if (p.size <=0 || p.colorA <= 0)
+        extent += fabsf(modeB.startRadius) + fabsf(modeB.startRadiusVar);
+    }
+    ParticleBounds b;
+    b.minX = x_ + _sourcePosition.x - fabsf(_posVar.x) - extent;
+    b.maxX = x_ + _sourcePosition.x + fabsf(_posVar.x) + extent;
+    b.minY = y_ + _sourcePosition.y - fabsf(_posVar.y) - extent;
+    b.maxY = y_ + _sourcePosition.y + fabsf(_posVar.y) + extent;
+    return b;
+}
+
+void ParticleSystem::prepareDrawData(float alpha, const SDL_Rect* viewport)
+{
+    _culledParticleCount = 0;
+    if (isSimulationThreadRunning())
+    {
+        auto& snapshot = acquireSnapshot();
+        //stored once, the simulation thread never sees a culled system as visible in between
+        bool culled = viewport && !snapshot.bounds.intersects(*viewport) && !(snapshot.isActive && getSpawnBounds().intersects(*viewport));
+        _isCulled.store(culled, std::memory_order_relaxed);
+        if (culled)
+        {
+            _culledParticleCount = snapshot.count;
+            _drawData.count = 0;
+            return;
+        }
+        if (alpha < 0)
+        {
+            alpha = 1;
+            if (snapshot.lastStepDt > 0)
+            {
+                std::chrono::duration<float> since = std::chrono::steady_clock::now() - snapshot.time;
+                alpha = clampf(since.count() / snapshot.lastStepDt, 0, 1);
+            }
+        }
+        resolveDrawData(snapshot.data, snapshot.count, alpha, snapshot.lastStepDt, viewport);
+    }
+    else
+    {
+        bool culled = viewport && !_bounds.intersects(*viewport) && !(_isActive && getSpawnBounds().intersects(*viewport));
+        _isCulled.store(culled, std::memory_order_relaxed);
+        if (culled)
+        {
+            _culledParticleCount = _particleCount;
+            _drawData.count = 0;
+            return;
+        }
+        if (alpha < 0)
+        {
+            alpha = getInterpolationAlpha();
+        }
+        resolveDrawData(particle_data_, _particleCount, alpha, _lastStepDt, viewport);
+    }
+}
+
+void ParticleSystem::render()
+{
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (_renderPath == RenderPath::GEOMETRY)
+    {
+        renderGeometry();
+        return;
+    }
+#endif
+    renderCopyEx();
+}
+
+void ParticleSystem::resolveDrawData(const ParticleData& p, int count, float alpha, float lastStepDt, const SDL_Rect* viewport)
+{
+    auto& d = _drawData;
+    d.reserve(count);
+    //a frame which is not in the atlas (e.g. the atlas was changed) is drawn as the first frame
+    unsigned int frames = _atlas ? _atlas->getFrameCount() : 0;
+    //sizes and colors change linearly, their values before the last step come from the deltas
+    float back = _isInterpolated ? (1 - alpha) * lastStepDt : 0;
+    int n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        //t is the time from the values in the streams
+        float t = -back;
+        float size = p.size[i];
+        if (_isStatelessAttributes)
+        {
+            t += p.lifeSpan[i] - p.timeToLive[i];
+            size -= (std::max)(0.0f, p.deltaSize[i]) * p.lifeSpan[i];
+        }
+        size += p.deltaSize[i] * t;
+        float a = p.colorA[i] + p.deltaColorA[i] * t;
+        if (size <= 0 || a <= 0)
         {
             continue;
         }
-        SDL_Rect r = { int(p.posx + p.startPosX - p.size / 2), int(p.posy + p.startPosY - p.size / 2), int(p.size), int(p.size) };
-        SDL_Color c = { Uint8(p.colorR * 255), Uint8(p.colorG * 255), Uint8(p.colorB * 255), Uint8(p.colorA * 255) };
+        float x = p.posx[i], y = p.posy[i];
+        if (_isInterpolated)
+        {
+            x = p.prevPosX[i] + (x - p.prevPosX[i]) * alpha;
+            y = p.prevPosY[i] + (y - p.prevPosY[i]) * alpha;
+        }
+        x += p.startPosX[i];
+        y += p.startPosY[i];
+        if (viewport)
+        {
+            //half of the diagonal, the particle may be rotated
+            float e = size * 0.7071068f;
+            if (x + e <= viewport->x || x - e >= viewport->x + viewport->w || y + e <= viewport->y || y - e >= viewport->y + viewport->h)
+            {
+                _culledParticleCount++;
+                continue;
+            }
+        }
+        d.x[n] = x;
+        d.y[n] = y;
+        d.size[n] = size;
+        d.rotation[n] = p.rotation[i] + p.deltaRotation[i] * t;
+        d.r[n] = clampf(p.colorR[i] + p.deltaColorR[i] * t, 0, 1);
+        d.g[n] = clampf(p.colorG[i] + p.deltaColorG[i] * t, 0, 1);
+        d.b[n] = clampf(p.colorB[i] + p.deltaColorB[i] * t, 0, 1);
+        d.a[n] = (std::min)(a, 1.0f);
+        d.frame[n] = p.atlasIndex[i] < frames ? p.atlasIndex[i] : 0;
+        n++;
+    }
+    d.count = n;
+}
+
+void ParticleSystem::renderCopyEx()
+{
+    auto& d = _drawData;
+    SDL_SetTextureBlendMode(_texture, getBlendMode());
+    for (int i = 0; i < d.count; i++)
+    {
+        SDL_Rect rect = { int(d.x[i] - d.size[i] / 2), int(d.y[i] - d.size[i] / 2), int(d.size[i]), int(d.size[i]) };
+        SDL_Color c = { Uint8(d.r[i] * 255), Uint8(d.g[i] * 255), Uint8(d.b[i] * 255), Uint8(d.a[i] * 255) };
         SDL_SetTextureColorMod(_texture, c.r, c.g, c.b);
         SDL_SetTextureAlphaMod(_texture, c.a);
-        SDL_SetTextureBlendMode(_texture, SDL_BLENDMODE_BLEND);
-        SDL_RenderCopyEx(_renderer, _texture, nullptr, &r, p.rotation, nullptr, SDL_FLIP_NONE);
+        SDL_RenderCopyEx(_renderer, _texture, _atlas ? &_atlas->getFrame(d.frame[i]) : nullptr, &rect, d.rotation[i], nullptr, SDL_FLIP_NONE);
+    }
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+void ParticleSystem::renderGeometry()
+{
+    auto& d = _drawData;
+    if (d.count == 0)
+    {
+        return;
+    }
+    if (int(_vertices.size()) < d.count * 4)
+    {
+        _vertices.resize(d.count * 4);
+        //the index pattern never changes, only build it when growing
+        int quads = int(_indices.size()) / 6;
+        _indices.resize(d.count * 6);
+        for (int q = quads; q < d.count; q++)
+        {
+            int* id = &_indices[q * 6];
+            int v = q * 4;
+            id[0] = v;
+            id[1] = v + 1;
+            id[2] = v + 2;
+            id[3] = v;
+            id[4] = v + 2;
+            id[5] = v + 3;
+        }
+    }
+    ParticleKernels::buildQuadVertices(d, _atlas ? _atlas->getTexCoords() : nullptr, _vertices.data());
+    SDL_SetTextureColorMod(_texture, 255, 255, 255);
+    SDL_SetTextureAlphaMod(_texture, 255);
+    SDL_SetTextureBlendMode(_texture, getBlendMode());
+    SDL_RenderGeometry(_renderer, _texture, _vertices.data(), d.count * 4, _indices.data(), d.count * 6);
+}
+#endif
+
+void ParticleSystem::startSimulationThread(float dt)
+{
+    stopSimulationThread();
+    //the first snapshot is published before the thread starts, so draw() always has a complete one
+    publishSnapshot();
+    acquireSnapshot();
+    _simulationThreadRunning = true;
+    _simulationThread = std::thread([this, dt]()
+        {
+            auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(dt));
+            auto next = std::chrono::steady_clock::now();
+            while (_simulationThreadRunning)
+            {
+                update(dt);
+                publishSnapshot();
+                next += period;
+                std::this_thread::sleep_until(next);
+            }
+        });
+}
+
+void ParticleSystem::stopSimulationThread()
+{
+    if (_simulationThread.joinable())
+    {
+        _simulationThreadRunning = false;
+        _simulationThread.join();
+    }
+}
+
+void ParticleSystem::publishSnapshot()
+{
+    auto& snapshot = _snapshots[_snapshotBack];
+    snapshot.data.copyRenderStreams(particle_data_, _particleCount);
+    snapshot.count = _particleCount;
+    snapshot.bounds = _bounds;
+    snapshot.isActive = _isActive;
+    snapshot.lastStepDt = _lastStepDt;
+    snapshot.time = std::chrono::steady_clock::now();
+    _snapshotBack = _snapshotMiddle.exchange(_snapshotBack | SNAPSHOT_NEW, std::memory_order_acq_rel) & ~SNAPSHOT_NEW;
+}
+
+const ParticleSnapshot& ParticleSystem::acquireSnapshot()
+{
+    if (_snapshotMiddle.load(std::memory_order_relaxed) & SNAPSHOT_NEW)
+    {
+        _snapshotFront = _snapshotMiddle.exchange(_snapshotFront, std::memory_order_acq_rel) & ~SNAPSHOT_NEW;
     }
-    update();
+    return _snapshots[_snapshotFront];
 }
 
 SDL_Texture* ParticleSystem::getTexture()
@@ -3,6 +3,11 @@
 //ֲCocos2dxȨ鿴licensesļ
 
 #include "SDL2/SDL.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <thread>
 #include <vector>
 #include <string>
 
@@ -37,48 +42,216 @@ struct Color4F
     float r = 0, g = 0, b = 0, a = 0;
 };
 
+/** Particle attributes stored as a structure of arrays.
+ * Each attribute is a separate contiguous stream, so a pass over a few attributes only touches those.
+ * All streams live in one block, every stream starts on a 64 bytes boundary and is padded to a multiple of 16 floats.
+ * Use particle_data_.posx[i] instead of particle_data_[i].posx.
+ */
 class ParticleData
 {
 public:
-    float posx = 0;
-    float posy = 0;
-    float startPosX = 0;
-    float startPosY = 0;
-
-    float colorR = 0;
-    float colorG = 0;
-    float colorB = 0;
-    float colorA = 0;
-
-    float deltaColorR = 0;
-    float deltaColorG = 0;
-    float deltaColorB = 0;
-    float deltaColorA = 0;
-
-    float size = 0;
-    float deltaSize = 0;
-    float rotation = 0;
-    float deltaRotation = 0;
-    float timeToLive = 0;
-    unsigned int atlasIndex = 0;
+    float* posx = nullptr;
+    float* posy = nullptr;
+    //position before the last step, only kept when the system is interpolated
+    float* prevPosX = nullptr;
+    float* prevPosY = nullptr;
+    float* startPosX = nullptr;
+    float* startPosY = nullptr;
+
+    float* colorR = nullptr;
+    float* colorG = nullptr;
+    float* colorB = nullptr;
+    float* colorA = nullptr;
+
+    float* deltaColorR = nullptr;
+    float* deltaColorG = nullptr;
+    float* deltaColorB = nullptr;
+    float* deltaColorA = nullptr;
+
+    float* size = nullptr;
+    float* deltaSize = nullptr;
+    float* rotation = nullptr;
+    float* deltaRotation = nullptr;
+    float* timeToLive = nullptr;
+    //life at the birth, the age is lifeSpan - timeToLive
+    float* lifeSpan = nullptr;
+    unsigned int* atlasIndex = nullptr;
 
     //! Mode A: gravity, direction, radial accel, tangential accel
     struct
     {
-        float dirX = 0;
-        float dirY = 0;
-        float radialAccel = 0;
-        float tangentialAccel = 0;
+        float* dirX = nullptr;
+        float* dirY = nullptr;
+        float* radialAccel = nullptr;
+        float* tangentialAccel = nullptr;
     } modeA;
 
     //! Mode B: radius mode
     struct
     {
-        float angle = 0;
-        float degreesPerSecond = 0;
-        float radius = 0;
-        float deltaRadius = 0;
+        float* angle = nullptr;
+        float* degreesPerSecond = nullptr;
+        float* radius = nullptr;
+        float* deltaRadius = nullptr;
     } modeB;
+
+    ParticleData() {}
+    ParticleData(const ParticleData&) = delete;
+    ParticleData& operator=(const ParticleData&) = delete;
+
+    /** Reallocates the streams for count particles, the first keep particles are preserved. */
+    void resize(int count, int keep);
+    int getMaxCount() const { return max_count_; }
+    /** Copies the streams used by rendering of the first count particles of src. */
+    void copyRenderStreams(const ParticleData& src, int count);
+    /** Copies all attributes of particle src to particle dst. */
+    void copyParticle(int dst, int src)
+    {
+        forEachStream([=](float*& s) { s[dst] = s[src]; });
+        atlasIndex[dst] = atlasIndex[src];
+    }
+
+private:
+    template <typename F>
+    void forEachStream(F f)
+    {
+        f(posx);
+        f(posy);
+        f(prevPosX);
+        f(prevPosY);
+        f(startPosX);
+        f(startPosY);
+        f(colorR);
+        f(colorG);
+        f(colorB);
+        f(colorA);
+        f(deltaColorR);
+        f(deltaColorG);
+        f(deltaColorB);
+        f(deltaColorA);
+        f(size);
+        f(deltaSize);
+        f(rotation);
+        f(deltaRotation);
+        f(timeToLive);
+        f(lifeSpan);
+        f(modeA.dirX);
+        f(modeA.dirY);
+        f(modeA.radialAccel);
+        f(modeA.tangentialAccel);
+        f(modeB.angle);
+        f(modeB.degreesPerSecond);
+        f(modeB.radius);
+        f(modeB.deltaRadius);
+    }
+
+    std::vector<float> buffer_;
+    std::vector<unsigned int> atlas_buffer_;
+    int max_count_ = 0;
+};
+
+/** A texture holding many sprites (frames). The systems sharing an atlas draw with the same texture,
+ * so they can be submitted together without switching textures.
+ */
+class ParticleAtlas
+{
+public:
+    ParticleAtlas(SDL_Texture* texture)
+        : texture_(texture)
+    {
+        SDL_QueryTexture(texture, nullptr, nullptr, &width_, &height_);
+    }
+    SDL_Texture* getTexture() const { return texture_; }
+
+    /** Adds a frame.
+     *
+     * @param rect The rect of the frame in pixels.
+     * @return The index of the frame.
+     */
+    int addFrame(const SDL_Rect& rect)
+    {
+        frames_.push_back(rect);
+        tex_coords_.push_back({ float(rect.x) / width_, float(rect.y) / height_, float(rect.w) / width_, float(rect.h) / height_ });
+        return int(frames_.size()) - 1;
+    }
+    /** Splits the whole texture into a grid of frames, row by row.
+     *
+     * @return The index of the first frame.
+     */
+    int addGrid(int columns, int rows)
+    {
+        int first = getFrameCount();
+        for (int j = 0; j < rows; j++)
+        {
+            for (int i = 0; i < columns; i++)
+            {
+                addFrame({ width_ * i / columns, height_ * j / rows, width_ / columns, height_ / rows });
+            }
+        }
+        return first;
+    }
+    int getFrameCount() const { return int(frames_.size()); }
+    const SDL_Rect& getFrame(int i) const { return frames_[i]; }
+    /** The frames in texture coordinates, [0, 1] of the texture. */
+    const SDL_FRect* getTexCoords() const { return tex_coords_.data(); }
+
+private:
+    SDL_Texture* texture_ = nullptr;
+    int width_ = 1, height_ = 1;
+    std::vector<SDL_Rect> frames_;
+    std::vector<SDL_FRect> tex_coords_;
+};
+
+/** The particles which will be drawn, with the final position of the center, size, rotation in degrees, color,
+ * and the frame in the atlas.
+ */
+struct ParticleDrawData
+{
+    std::vector<float> x, y, size, rotation, r, g, b, a;
+    std::vector<unsigned int> frame;
+    int count = 0;
+    /** Makes room for n particles, the memory is kept between frames. */
+    void reserve(int n)
+    {
+        if (int(x.size()) < n)
+        {
+            for (auto v : { &x, &y, &size, &rotation, &r, &g, &b, &a })
+            {
+                v->resize(n);
+            }
+            frame.resize(n);
+        }
+    }
+};
+
+/** An axis aligned box of the particles in the coordinates of the target, empty when the minimum is over the maximum. */
+struct ParticleBounds
+{
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    bool isEmpty() const { return minX > maxX || minY > maxY; }
+    void merge(const ParticleBounds& b)
+    {
+        minX = (std::min)(minX, b.minX);
+        minY = (std::min)(minY, b.minY);
+        maxX = (std::max)(maxX, b.maxX);
+        maxY = (std::max)(maxY, b.maxY);
+    }
+    bool intersects(const SDL_Rect& r) const
+    {
+        return minX < r.x + r.w && maxX > r.x && minY < r.y + r.h && maxY > r.y;
+    }
+};
+
+/** What draw() needs of the particles after a step, handed from the simulation thread to the render thread. */
+struct ParticleSnapshot
+{
+    ParticleData data;
+    int count = 0;
+    ParticleBounds bounds;
+    //whether the emitter was still emitting, its spawn area is then kept by the culling
+    bool isActive = false;
+    float lastStepDt = 0;
+    std::chrono::steady_clock::time_point time;
 };
 
 //typedef void (*CC_UPDATE_PARTICLE_IMP)(id, SEL, tParticle*, Vec2);
@@ -116,8 +289,16 @@ emitter.startSpin = 0;
 
 */
 
+class ParticleJobPool;
+class ParticleRenderQueue;
+class ParticleSoftwareRenderer;
+
 class ParticleSystem
 {
+    friend class ParticleJobPool;
+    friend class ParticleRenderQueue;
+    friend class ParticleSoftwareRenderer;
+
 public:
     enum class Mode
     {
@@ -125,6 +306,46 @@ public:
         RADIUS,
     };
 
+    /** Precision of sin/cos in the 'Radius' mode update. */
+    enum class TrigPrecision
+    {
+        /** sinf/cosf of the C library, scalar only */
+        LIBM,
+        /** polynomial, max error about 1e-7 */
+        ACCURATE,
+        /** shorter polynomial, max error about 1e-5 */
+        FAST,
+    };
+
+    /** How draw() submits the particles to the renderer. */
+    enum class RenderPath
+    {
+        /** SDL_RenderCopyEx for each particle */
+        COPY_EX,
+        /** one SDL_RenderGeometry for the whole system, needs SDL 2.0.18, otherwise COPY_EX is used */
+        GEOMETRY,
+    };
+
+    /** How update() walks the particles. */
+    enum class UpdatePath
+    {
+        /** one sweep for each stage: life, rebirth, motion, then color/size/rotation */
+        MULTI_PASS,
+        /** all the stages on a block of particles before the next block, the dead ones are compacted in the same pass */
+        FUSED,
+    };
+
+    /** How much update() simulates, e.g. less for the systems out of the screen. */
+    enum class Activity
+    {
+        /** every update is simulated */
+        FULL,
+        /** the time is accumulated and simulated in steps of the reduced time step */
+        REDUCED,
+        /** nothing is simulated, the time is accumulated until the system is woken */
+        FROZEN,
+    };
+
     enum
     {
         /** The Particle emitter lives forever. */
@@ -316,23 +537,131 @@ public:
      */
     virtual bool isActive() const;
 
-    /** Gets the index of system in batch node array.
+    /** Gets the first frame of the system in its atlas.
      *
-     * @return The index of system in batch node array.
+     * @return The first frame of the system in its atlas.
      */
     int getAtlasIndex() const { return _atlasIndex; }
-    /** Sets the index of system in batch node array.
+    /** Sets the first frame of the system in its atlas.
      *
-     * @param index The index of system in batch node array.
+     * @param index The first frame of the system in its atlas.
      */
     void setAtlasIndex(int index) { _atlasIndex = index; }
 
+    /** Draws the particles with frames of an atlas instead of the whole texture, the texture of the system becomes the
+     * texture of the atlas. Each new particle takes a random frame in [firstFrame, firstFrame + frameCount).
+     * The atlas is not owned by the system and can be shared by many systems.
+     *
+     * @param atlas The atlas, nullptr to draw the whole texture again.
+     * @param firstFrame The first frame of the system.
+     * @param frameCount The number of frames of the system.
+     */
+    void setAtlas(ParticleAtlas* atlas, int firstFrame = 0, int frameCount = 1);
+    ParticleAtlas* getAtlas() const { return _atlas; }
+    int getAtlasFrameCount() const { return _atlasFrameCount; }
+
     /** Gets the Quantity of particles that are being simulated at the moment.
      *
      * @return The Quantity of particles that are being simulated at the moment.
      */
     unsigned int getParticleCount() const { return _particleCount; }
 
+    /** Gets the number of particles which died in the last update.
+     *
+     * @return The number of particles which died in the last update.
+     */
+    int getDeadParticleCount() const { return _deadParticleCount; }
+
+    /** Gets a box containing all the particles as they are drawn, rotated squares of their sizes included.
+     * It is updated in the motion pass of each step and is conservative: it may be larger than the particles,
+     * e.g. with the interpolation it also contains the particles before the step.
+     *
+     * @return The box, empty when there is no particle.
+     */
+    const ParticleBounds& getBounds() const { return _bounds; }
+
+    /** Sets the visible rect of the target for culling. When it is set, draw() skips the whole system if its bounds
+     * are out of the rect, and drops the particles out of the rect before building the geometry.
+     * A ParticleSoftwareRenderer culls by its surface when no rect is set.
+     *
+     * @param viewport The visible rect in the coordinates of the particles, nullptr to draw all the particles.
+     */
+    void setViewport(const SDL_Rect* viewport);
+
+    /** Sets how much update() simulates. The time which is not simulated is caught up by fastForward()
+     * in the first update() at a higher activity, so a woken system looks as if it had been running.
+     *
+     * @param activity The activity.
+     */
+    void setActivity(Activity activity) { _activity = activity; }
+    Activity getActivity() const { return _activity; }
+    /** Sets the activity used instead when the last draw culled the whole system, if it is lower than getActivity().
+     * FULL (the default) means that the culling does not change the activity.
+     *
+     * @param activity The activity of a culled system.
+     */
+    void setCulledActivity(Activity activity) { _culledActivity = activity; }
+    Activity getCulledActivity() const { return _culledActivity; }
+    /** Gets the activity used by the next update(). */
+    Activity getEffectiveActivity() const { return isCulled() ? (std::max)(_activity, _culledActivity) : _activity; }
+    /** Sets the length of the steps at Activity::REDUCED, in seconds. */
+    void setReducedTimeStep(float step) { _reducedTimeStep = step; }
+    float getReducedTimeStep() const { return _reducedTimeStep; }
+    /** Gets the time accumulated at a lower activity which has not been simulated yet. */
+    float getSleepTime() const { return _sleepTime; }
+
+    /** Sets the priority in ParticleBudget, the systems of a higher priority get their particles first. The default is 0. */
+    void setPriority(int priority) { _priority = priority; }
+    int getPriority() const { return _priority; }
+    /** Sets the distance from the camera or the player, ParticleBudget gives less to the far systems of a priority. */
+    void setDistance(float distance) { _distance = distance; }
+    float getDistance() const { return _distance; }
+    /** Gets the fraction of the emission rate and the total particles given by ParticleBudget, 1 when it is not limited. */
+    float getBudgetScale() const { return _budgetScale.load(std::memory_order_relaxed); }
+    /** Gets the emission rate scaled by the budget, which is used by the simulation. */
+    float getEffectiveEmissionRate() const { return _emissionRate * getBudgetScale(); }
+    /** Gets the total particles scaled by the budget, which is used by the simulation. */
+    int getEffectiveTotalParticles() const { return int(_totalParticles * getBudgetScale()); }
+    /** Gets the particles alive, which is safe to call by the drawing thread when the simulation thread is running. */
+    int getLiveParticleCount() const { return isSimulationThreadRunning() ? _snapshots[_snapshotFront].count : _particleCount; }
+
+    /** Sets the seed of the random numbers of the spawned particles and restarts their sequence.
+     * A particle gets its random numbers from a hash of the seed, its serial number and the attribute, so the same
+     * seed and the same updates give the same particles in any run, and no state is shared with rand().
+     * The default seed is taken from rand() when the system is created.
+     */
+    void setSeed(unsigned int seed)
+    {
+        _seed = seed;
+        _spawnSerial = 0;
+    }
+    unsigned int getSeed() const { return _seed; }
+
+    /** Advances the system by seconds at once, without stepping. When the motion has a closed form (constant gravity,
+     * or constant angular velocity with linear radius), the particles alive are moved in closed form, those which
+     * would die are removed, and the particles which would have been emitted in the period and still be alive are
+     * added with their ages. When the system would be full, fewer particles are added, still spread over the whole
+     * period like the emission of a full system, which waits for particles to die. With radial or tangential
+     * acceleration the whole system runs in coarse steps, as long as the acceleration allows (0.1 to 1 second), and
+     * the particles emitted in a step are spread over it.
+     *
+     * @param seconds The time to advance.
+     */
+    void fastForward(float seconds);
+    /** Fills the system as if it had been running for seconds, e.g. after setStyle() for the effects which should
+     * not start empty like SNOW or RAIN. Unlike fastForward(), the elapsed time is kept, so a system with a duration
+     * still runs all of it after.
+     *
+     * @param seconds The time to run, negative for the longest life of a particle, which reaches the steady state.
+     */
+    void prewarm(float seconds = -1);
+    /** Whether the whole system was skipped by the last draw: the particles, and the spawn area while the emitter is
+     * active, are out of the viewport.
+     */
+    bool isCulled() const { return _isCulled.load(std::memory_order_relaxed); }
+    /** Gets the number of particles dropped by the culling in the last draw. */
+    int getCulledParticleCount() const { return _culledParticleCount; }
+
     /** Gets how many seconds the emitter will run. -1 means 'forever'.
      *
      * @return The seconds that the emitter will run. -1 means 'forever'.
@@ -423,6 +752,39 @@ public:
      */
     void setEmitterMode(Mode mode) { _emitterMode = mode; }
 
+    /** Gets the precision of sin/cos in 'Radius' mode.
+     *
+     * @return The precision of sin/cos.
+     */
+    TrigPrecision getTrigPrecision() const { return _trigPrecision; }
+    /** Sets the precision of sin/cos in 'Radius' mode. The polynomial ones are computed in batches by SIMD.
+     *
+     * @param precision The precision of sin/cos.
+     */
+    void setTrigPrecision(TrigPrecision precision) { _trigPrecision = precision; }
+
+    /** Gets how update() walks the particles.
+     *
+     * @return The update path.
+     */
+    UpdatePath getUpdatePath() const { return _updatePath; }
+    /** Sets how update() walks the particles. MULTI_PASS is kept for comparing with FUSED.
+     *
+     * @param path The update path.
+     */
+    void setUpdatePath(UpdatePath path) { _updatePath = path; }
+
+    /** Gets how draw() submits the particles to the renderer.
+     *
+     * @return The render path.
+     */
+    RenderPath getRenderPath() const { return _renderPath; }
+    /** Sets how draw() submits the particles to the renderer.
+     *
+     * @param path The render path.
+     */
+    void setRenderPath(RenderPath path) { _renderPath = path; }
+
     /** Gets the start size in pixels of each particle.
      *
      * @return The start size in pixels of each particle.
@@ -577,14 +939,138 @@ public:
      */
     virtual void setTotalParticles(int totalParticles);
 
+    /** Whether or not the particles are using blend additive.
+     * If enabled, the particles are rendered with SDL_BLENDMODE_ADD, otherwise with SDL_BLENDMODE_BLEND.
+     */
+    bool isBlendAdditive() const { return _isBlendAdditive; }
+    void setBlendAdditive(bool value) { _isBlendAdditive = value; }
+
     /** does the alpha value modify color */
     void setOpacityModifyRGB(bool opacityModifyRGB) { _opacityModifyRGB = opacityModifyRGB; }
     bool isOpacityModifyRGB() const { return _opacityModifyRGB; }
 
     SDL_Texture* getTexture();
     void setTexture(SDL_Texture* texture);
+    /** Renders the particles, it does not advance the system, call update() or run the simulation thread for that.
+     * The interpolation alpha is getInterpolationAlpha(), or the time since the latest snapshot with the simulation thread.
+     */
     void draw();
+    /** Renders the particles between the last two steps when the system is interpolated.
+     *
+     * @param alpha 0 renders the state before the last step, 1 renders the current state.
+     */
+    void draw(float alpha);
+    /** Adds the particles to a render queue instead of rendering them at once, see ParticleRenderQueue.
+     * The interpolation alpha is the same as draw().
+     *
+     * @param queue The queue, the particles are rendered when it is flushed.
+     * @param layer The systems in a lower layer are rendered under those in a higher layer.
+     */
+    void draw(ParticleRenderQueue& queue, int layer = 0);
+    /** Adds the particles to a software renderer, which rasterizes them on the CPU without a renderer or a GPU.
+     * The interpolation alpha is the same as draw().
+     *
+     * @param renderer The renderer, the particles are rasterized when it renders.
+     */
+    void draw(ParticleSoftwareRenderer& renderer);
+    /** Gets the blend mode used to render the particles, SDL_BLENDMODE_ADD when the system is additive. */
+    SDL_BlendMode getBlendMode() const { return _isBlendAdditive ? SDL_BLENDMODE_ADD : SDL_BLENDMODE_BLEND; }
+    /** Whether the result does not depend on the order of drawing, which is true for additive blending.
+     * ParticleRenderQueue merges such systems across emitters and layers.
+     */
+    bool isOrderIndependent() const { return getBlendMode() == SDL_BLENDMODE_ADD; }
+    /** Advances the system by 1/25 second. */
     void update();
+    /** Advances the system by dt seconds, in steps of the fixed time step if it is set.
+     *
+     * @param dt The time since the last update in seconds.
+     */
+    void update(float dt);
+
+    /** Handles the activity and the fixed time step of update(dt), fast forwarding the system after a sleep.
+     * It is the first of the phases of update(dt), to run the update on a job system of your own. With the fused update
+     * path, update(dt) is the same as:
+     *
+     * @code
+     * float step;
+     * int steps = p->prepareSteps(dt, step);
+     * for (int k = 0; k < steps; k++)
+     * {
+     *     p->emit(step);
+     *     ParticleBounds bounds;    // one for each range, merged before compact()
+     *     p->integrate(0, p->getParticleCount(), step, bounds);
+     *     p->compact(bounds);
+     * }
+     * @endcode
+     *
+     * Threading: the phases of a system must run in this order, and only integrate() may run on several threads at
+     * once, on disjoint ranges of the particles and with a bounds for each range. integrate() reads the parameters of
+     * the system and writes nothing but the particles of its range and its bounds, so nothing else of the system may
+     * be called until all the ranges are done. Different systems are independent, any phase of them can run on
+     * different threads at once. The particle count does not change between emit() and compact().
+     *
+     * @param dt The time since the last update in seconds.
+     * @param step The length of the steps to simulate.
+     * @return The number of steps to simulate.
+     */
+    int prepareSteps(float dt, float& step);
+    /** The emission of a step, also advances the elapsed time and stops the system at the end of the duration. */
+    void emit(float dt);
+    /** Ages, moves and changes the particles in [begin, end) by a step, and merges them into bounds.
+     * The ranges which begin at multiples of FUSED_BLOCK give the same result as update(dt) to the bit.
+     */
+    void integrate(int begin, int end, float dt, ParticleBounds& bounds);
+    /** Removes the particles whose life is over keeping the order, and sets the bounds of the step.
+     *
+     * @param bounds The bounds of all the ranges of the step.
+     */
+    void compact(const ParticleBounds& bounds);
+    /** particles in a block of the fused update */
+    static const int FUSED_BLOCK = 256;
+
+    /** Sets a fixed time step for update(dt). The time passed to update(dt) is accumulated and the simulation runs in steps
+     * of this length, at most maxSubSteps for one call. The time which is more than that is dropped.
+     * A step longer than the frame time runs the simulation at a lower rate than the rendering.
+     *
+     * @param step The length of a step in seconds, 0 means to use the time passed to update(dt) directly.
+     * @param maxSubSteps The maximum steps for one update(dt).
+     */
+    void setFixedTimeStep(float step, int maxSubSteps = 5);
+    float getFixedTimeStep() const { return _fixedTimeStep; }
+    int getMaxSubSteps() const { return _maxSubSteps; }
+
+    /** Sets whether draw(alpha) blends the positions, sizes and colors between the last two steps.
+     * The positions before the step are kept in an extra stream, the sizes and colors are recovered from their deltas.
+     * It allows a low simulation rate with setFixedTimeStep() without visible stepping.
+     *
+     * @param interpolated True to interpolate.
+     */
+    void setInterpolated(bool interpolated);
+    bool isInterpolated() const { return _isInterpolated; }
+    /** Sets whether the colors, sizes and rotations are evaluated from the ages of the particles when drawing,
+     * instead of being advanced by every step. They change linearly over the life, so the streams keep the values
+     * at the birth and the update does not write them at all. The sizes are clamped at 0 like the stepped ones.
+     *
+     * @param stateless True to evaluate them when drawing.
+     */
+    void setStatelessAttributes(bool stateless);
+    bool isStatelessAttributes() const { return _isStatelessAttributes; }
+    /** Gets the fraction of the fixed time step which has not been simulated, for draw(alpha).
+     *
+     * @return The alpha for draw(alpha), 1 when there is no fixed time step.
+     */
+    float getInterpolationAlpha() const { return _fixedTimeStep > 0 ? _timeAccumulator / _fixedTimeStep : 1.0f; }
+
+    /** Runs update(dt) every dt seconds on a background thread. After each update the particles are copied to a snapshot,
+     * and draw() renders the latest snapshot while the next one is being written. The snapshots are handed over without locks.
+     * While the thread is running, draw() is the only method which can be called from other threads,
+     * stop the thread before changing the parameters of the system.
+     *
+     * @param dt The time between two updates in seconds.
+     */
+    void startSimulationThread(float dt = 1.0f / 25);
+    void stopSimulationThread();
+    bool isSimulationThreadRunning() const { return _simulationThread.joinable(); }
 
     ParticleSystem();
     virtual ~ParticleSystem();
@@ -598,6 +1084,50 @@ public:
 
 protected:
     //virtual void updateBlendFunc();
+    /** One step of the simulation: emit, integrate all the particles, then compact. */
+    void simulate(float dt);
+    void finishStep(const ParticleBounds& bounds);
+    void updateMultiPass(float dt, ParticleBounds& bounds);
+    void updateFused(float dt, ParticleBounds& bounds);
+    void updateMotion(int begin, int end, float dt);
+    /** Runs the version of updateColorSizeRotation() specialized for the attributes which change. */
+    void updateColorSizeRotation(int begin, int end, float dt);
+    template <bool COLOR, bool SIZE, bool ROTATION>
+    void updateColorSizeRotation(int begin, int end, float dt);
+    /** Gets the ParticleKernels::Feature flags of the particles spawned with the current configuration. */
+    unsigned int getSpawnFeatures() const;
+    /** Removes all the particles whose life is over in one pass, the living ones stay dense at the front.
+     *
+     * @return The number of removed particles.
+     */
+    int compactParticles();
+    /** Fills _drawData from the particles of this frame, the live ones or the front snapshot.
+     *
+     * @param alpha The interpolation alpha, negative to compute it like draw().
+     * @param viewport The visible rect, nullptr for no culling.
+     */
+    void prepareDrawData(float alpha, const SDL_Rect* viewport);
+    /** Gets the area where the emitter spawns particles at their start size, which an active emitter keeps visible
+     * for the culling even without particles.
+     */
+    ParticleBounds getSpawnBounds() const;
+    /** Renders _drawData to _renderer by the render path. */
+    void render();
+    /** Moves particle i, its color, size and rotation by t seconds in closed form. */
+    void advanceParticle(int i, float t);
+    /** fastForward() in coarse steps of the whole system, for the motion without closed form. */
+    void fastForwardSteps(float seconds);
+    /** Fills _drawData with the visible particles. */
+    void resolveDrawData(const ParticleData& p, int count, float alpha, float lastStepDt, const SDL_Rect* viewport);
+    void renderCopyEx();
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    /** Builds a rotated quad for each particle in _drawData and submits them by one SDL_RenderGeometry. */
+    void renderGeometry();
+#endif
+    /** Copies the particles to the back snapshot and exchanges it with the middle one. Called by the simulation thread. */
+    void publishSnapshot();
+    /** Exchanges the front snapshot with the middle one if that is newer. Called by the render thread. */
+    const ParticleSnapshot& acquireSnapshot();
 
 protected:
     /** whether or not the particles are using blend additive.
@@ -659,7 +1189,7 @@ protected:
     } modeB;
 
     //particle data
-    std::vector<ParticleData> particle_data_;
+    ParticleData particle_data_;
 
     //Emitter name
     std::string _configName;
@@ -669,6 +1199,12 @@ protected:
 
     //! How many particles can be emitted per second
     float _emitCounter = 0;
+    /** seed of the random numbers of spawning */
+    unsigned int _seed = 0;
+    /** serial number of the next spawned particle */
+    unsigned int _spawnSerial = 0;
+    /** random attributes of a batch of spawned particles which are not stored as they are */
+    std::vector<float> _spawnScratch;
 
     // Optimization
     //CC_UPDATE_PARTICLE_IMP    updateParticleImp;
@@ -677,8 +1213,12 @@ protected:
     /** weak reference to the SpriteBatchNode that renders the Sprite */
     //ParticleBatchNode* _batchNode;
 
-    // index of system in batch node array
+    // first frame of the system in the atlas
     int _atlasIndex = 0;
+    // number of frames of the system in the atlas
+    int _atlasFrameCount = 1;
+    /** atlas of the frames, not owned */
+    ParticleAtlas* _atlas = nullptr;
 
     //true if scaled or rotated
     bool _transformSystemDirty = false;
@@ -691,6 +1231,38 @@ protected:
     /** Quantity of particles that are being simulated at the moment */
     int _particleCount = 0;
 
+    /** Quantity of particles which died in the last update */
+    int _deadParticleCount = 0;
+
+    /** bounds of the particles after the last step, what is drawn */
+    ParticleBounds _bounds;
+    /** bounds of the particles after the last step without the interpolation */
+    ParticleBounds _stepBounds;
+    /** visible rect for culling */
+    SDL_Rect _viewport = { 0, 0, 0, 0 };
+    bool _isViewportSet = false;
+    /** written by draw() and read by update(), which may run on the simulation thread */
+    std::atomic<bool> _isCulled{ false };
+    int _culledParticleCount = 0;
+
+    /** how much update() simulates */
+    Activity _activity = Activity::FULL;
+    /** activity when the system was culled by the last draw */
+    Activity _culledActivity = Activity::FULL;
+    /** step at Activity::REDUCED */
+    float _reducedTimeStep = 0.25f;
+    /** time not simulated at a lower activity */
+    float _sleepTime = 0;
+
+    /** priority in ParticleBudget */
+    int _priority = 0;
+    /** distance from the camera for ParticleBudget */
+    float _distance = 0;
+    /** fraction of the emission rate and the total particles given by ParticleBudget, written by the drawing thread */
+    std::atomic<float> _budgetScale{ 1.0f };
+    void setBudgetScale(float scale) { _budgetScale.store(scale, std::memory_order_relaxed); }
+    friend class ParticleBudget;
+
     /** How many seconds the emitter will run. -1 means 'forever' */
     float _duration = 0;
     /** sourcePosition of the emitter */
@@ -712,6 +1284,47 @@ protected:
     */
     Mode _emitterMode = Mode::GRAVITY;
 
+    /** precision of sin/cos in 'Radius' mode */
+    TrigPrecision _trigPrecision = TrigPrecision::ACCURATE;
+
+    /** how update() walks the particles */
+    UpdatePath _updatePath = UpdatePath::FUSED;
+
+    /** how draw() submits the particles */
+    RenderPath _renderPath = RenderPath::GEOMETRY;
+    /** particles to draw in this frame */
+    ParticleDrawData _drawData;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    /** vertices and indices of the quads, reused between frames */
+    std::vector<SDL_Vertex> _vertices;
+    std::vector<int> _indices;
+#endif
+
+    /** fixed time step of update(dt), 0 means variable */
+    float _fixedTimeStep = 0;
+    /** maximum steps for one update(dt) */
+    int _maxSubSteps = 5;
+    /** time passed to update(dt) which has not been simulated */
+    float _timeAccumulator = 0;
+    /** length of the last step */
+    float _lastStepDt = 0;
+    /** whether draw(alpha) interpolates between the last two steps */
+    bool _isInterpolated = false;
+    /** the colors and the rotations are at the birth, and the size is the largest of the life */
+    bool _isStatelessAttributes = false;
+    /** ParticleKernels::Feature flags of all the particles alive, which select the specialized update kernels */
+    unsigned int _features = 0;
+
+    /** snapshots for the simulation thread: the back one is written by the thread, the front one is read by draw(),
+    the middle one is the latest complete snapshot. _snapshotMiddle has SNAPSHOT_NEW when it has not been taken. */
+    ParticleSnapshot _snapshots[3];
+    int _snapshotBack = 0;
+    std::atomic<int> _snapshotMiddle{ 1 };
+    int _snapshotFront = 2;
+    static const int SNAPSHOT_NEW = 4;
+    std::thread _simulationThread;
+    std::atomic<bool> _simulationThreadRunning{ false };
+
     /** start size in pixels of each particle */
     float _startSize = 0;
     /** size variance in pixels of each particle */
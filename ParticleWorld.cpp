@@ -0,0 +1,122 @@
+#include "ParticleWorld.h"
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+ParticleWorld::ParticleWorld(SDL_Renderer* renderer, int blockSize)
+    : renderer_(renderer)
+    , block_size_((std::max)(1, blockSize))
+{
+    setThreadCount(0);
+}
+
+ParticleWorld::~ParticleWorld()
+{
+    clear();
+}
+
+void ParticleWorld::setThreadCount(int threads)
+{
+    threads_ = threads > 0 ? threads : (std::max)(1, SDL_GetCPUCount());
+    //the threads are started by the next parallel update
+    pool_.reset();
+}
+
+ParticleExample* ParticleWorld::create(int layer)
+{
+    if (free_slots_.empty())
+    {
+        //operator new[] of unsigned char is aligned for any fundamental type, the slot size keeps it for each slot
+        static_assert(alignof(ParticleExample) <= alignof(std::max_align_t), "ParticleExample needs extended alignment");
+        blocks_.emplace_back(new unsigned char[sizeof(ParticleExample) * block_size_]);
+        auto block = reinterpret_cast<ParticleExample*>(blocks_.back().get());
+        //the first slots of a block are taken first
+        for (int i = block_size_ - 1; i >= 0; i--)
+        {
+            free_slots_.push_back(block + i);
+        }
+    }
+    auto system = new (free_slots_.back()) ParticleExample();
+    free_slots_.pop_back();
+    system->setRenderer(renderer_);
+    entries_.push_back({ system, layer });
+    return system;
+}
+
+void ParticleWorld::destroy(int entry)
+{
+    auto system = entries_[entry].system;
+    system->~ParticleExample();
+    free_slots_.push_back(system);
+    //keep the order, it is the drawing order in a layer
+    entries_.erase(entries_.begin() + entry);
+}
+
+void ParticleWorld::remove(ParticleSystem* system)
+{
+    for (int i = 0; i < int(entries_.size()); i++)
+    {
+        if (entries_[i].system == system)
+        {
+            destroy(i);
+            return;
+        }
+    }
+}
+
+void ParticleWorld::clear()
+{
+    while (!entries_.empty())
+    {
+        destroy(int(entries_.size()) - 1);
+    }
+}
+
+void ParticleWorld::update(float dt, bool parallel)
+{
+    if (parallel && threads_ > 1)
+    {
+        if (!pool_)
+        {
+            pool_.reset(new ParticleJobPool(threads_));
+        }
+        update_systems_.clear();
+        for (auto& e : entries_)
+        {
+            update_systems_.push_back(e.system);
+        }
+        pool_->update(update_systems_.data(), int(update_systems_.size()), dt);
+    }
+    else
+    {
+        for (auto& e : entries_)
+        {
+            e.system->update(dt);
+        }
+    }
+
+    //recycle the finished systems
+    for (int i = int(entries_.size()) - 1; i >= 0; i--)
+    {
+        auto system = entries_[i].system;
+        if (system->isAutoRemoveOnFinish() && !system->isActive() && system->getParticleCount() == 0)
+        {
+            destroy(i);
+        }
+    }
+}
+
+void ParticleWorld::draw(ParticleRenderQueue& queue)
+{
+    for (auto& e : entries_)
+    {
+        e.system->draw(queue, e.layer);
+    }
+}
+
+void ParticleWorld::draw()
+{
+    queue_.clear();
+    draw(queue_);
+    queue_.flush();
+}
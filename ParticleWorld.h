@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ParticleExample.h"
+#include "ParticleJobPool.h"
+#include "ParticleRenderQueue.h"
+#include <memory>
+
+/** Owns many systems and updates and draws them together.
+ * The systems are constructed in blocks of contiguous slots, a removed system leaves its slot to the next one created,
+ * so creating and removing effects does not allocate after the first blocks.
+ * A system which has finished (stopped and without particles) is removed by update() if it is set to be removed on
+ * finish. Note that setStyle() resets the flag, set it after the style.
+ *
+ * @code
+ * ParticleWorld world(renderer);
+ * auto p = world.create();
+ * p->setStyle(ParticleExample::EXPLOSION);
+ * p->setAutoRemoveOnFinish(true);
+ * ...
+ * world.update(dt);
+ * world.draw();
+ * @endcode
+ */
+class ParticleWorld
+{
+public:
+    /** @param blockSize The number of systems in a block of the pool. */
+    ParticleWorld(SDL_Renderer* renderer, int blockSize = 64);
+    ~ParticleWorld();
+    ParticleWorld(const ParticleWorld&) = delete;
+    ParticleWorld& operator=(const ParticleWorld&) = delete;
+
+    /** Creates a system owned by the world, with the renderer of the world.
+     *
+     * @param layer The layer of the system in the render queue.
+     * @return The system, it is valid until it is removed.
+     */
+    ParticleExample* create(int layer = 0);
+    /** Destroys a system of the world at once. */
+    void remove(ParticleSystem* system);
+    /** Destroys all the systems, the blocks are kept. */
+    void clear();
+
+    /** Updates all the systems, then removes the finished ones which are set to be removed on finish.
+     *
+     * @param dt The time since the last update in seconds.
+     * @param parallel Whether to update the systems on the job pool of the world. The systems must not share
+     *                 anything written by update(); the result is the same as the serial one, see ParticleJobPool.
+     */
+    void update(float dt = 1.0f / 25, bool parallel = false);
+    /** Draws all the systems as one batch: they are added to the queue of the world, which is flushed. */
+    void draw();
+    /** Adds all the systems to a queue, e.g. to merge them with systems out of the world. */
+    void draw(ParticleRenderQueue& queue);
+
+    int getSystemCount() const { return int(entries_.size()); }
+    ParticleExample* getSystem(int i) const { return entries_[i].system; }
+    /** Gets the statistics of the last draw(). */
+    const ParticleRenderQueue::Stats& getRenderStats() const { return queue_.getStats(); }
+    /** Sets the number of threads of a parallel update, 0 for the number of CPUs.
+     * The threads are started by the first parallel update(), a world updated serially has none.
+     */
+    void setThreadCount(int threads);
+    int getThreadCount() const { return threads_; }
+
+private:
+    struct Entry
+    {
+        ParticleExample* system;
+        int layer;
+    };
+    void destroy(int entry);
+
+    SDL_Renderer* renderer_ = nullptr;
+    int block_size_ = 64;
+    int threads_ = 1;
+    std::unique_ptr<ParticleJobPool> pool_;
+    std::vector<ParticleSystem*> update_systems_;
+    //raw storage of the systems, each block holds block_size_ slots
+    std::vector<std::unique_ptr<unsigned char[]>> blocks_;
+    std::vector<ParticleExample*> free_slots_;
+    std::vector<Entry> entries_;
+    ParticleRenderQueue queue_;
+};
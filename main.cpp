@@ -30,8 +30,9 @@ int main(int, char* argv[])
             break;
         }
 
+        p->update();    // advance it, or call p->startSimulationThread() once to update it on a background thread
         SDL_RenderClear(ren);
-        p->draw();    // you have to draw it in each loop
+        p->draw();      // you have to draw it in each loop
         SDL_RenderPresent(ren);
         SDL_Delay(10);
     }
@@ -0,0 +1,57 @@
+//Measures the throughput of a parallel ParticleWorld::update() from 1 thread to the number of CPUs. The world holds
+//many small systems and a few big ones, which the job pool splits into chunks.
+#include "../ParticleWorld.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char* argv[])
+{
+    int maxThreads = argc > 1 ? atoi(argv[1]) : SDL_GetCPUCount();
+    const int frames = 200;
+    const float dt = 1.0f / 60;
+
+    ParticleWorld world(nullptr);
+    for (int i = 0; i < 64; i++)
+    {
+        auto p = world.create();
+        p->setStyle(ParticleExample::PatticleStyle(i % 10 + 1));
+        p->setDuration(ParticleSystem::DURATION_INFINITY);
+        p->setSeed(i);
+        int total = i % 16 == 0 ? 100000 : 5000;
+        p->resetTotalParticles(total);
+        p->setTotalParticles(total);
+        p->setEmissionRate(total / p->getLife());
+    }
+    //to the steady state
+    for (int f = 0; f < 300; f++)
+    {
+        world.update(dt);
+    }
+
+    double base = 0;
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+        world.setThreadCount(threads);
+        world.update(dt, true);
+        long long particles = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++)
+        {
+            world.update(dt, true);
+            for (int i = 0; i < world.getSystemCount(); i++)
+            {
+                particles += world.getSystem(i)->getParticleCount();
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double throughput = particles / seconds;
+        if (threads == 1)
+        {
+            base = throughput;
+        }
+        printf("%2d threads: %7.2f ms/frame, %7.1f M particle updates/s, speedup %.2f\n", threads, seconds * 1000 / frames,
+            throughput / 1e6, throughput / base);
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+//Compares prewarm() with stepped update() for a system which is full most of the time: the count and the mean age
+//of the particles should be close.
+#include "../ParticleExample.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+class AgedParticles : public ParticleExample
+{
+public:
+    float getMeanAge() const
+    {
+        auto& d = particle_data_;
+        float age = 0;
+        int count = int(getParticleCount());
+        for (int i = 0; i < count; i++)
+        {
+            age += d.lifeSpan[i] - d.timeToLive[i];
+        }
+        return count ? age / count : 0;
+    }
+};
+
+static void setup(AgedParticles& p)
+{
+    p.setPosition(512, 384);
+    p.setStyle(ParticleExample::FIRE);
+    p.setSeed(1);
+    p.resetTotalParticles(200);
+    p.setTotalParticles(200);
+    //5 times the rate which keeps 200 alive
+    p.setLife(2);
+    p.setLifeVar(0.5f);
+    p.setEmissionRate(500);
+}
+
+int main()
+{
+    AgedParticles stepped, prewarmed;
+    setup(stepped);
+    setup(prewarmed);
+    float seconds = 10;
+    for (int i = 0; i < int(seconds * 100); i++)
+    {
+        stepped.update(0.01f);
+    }
+    prewarmed.prewarm(seconds);
+
+    int steppedCount = int(stepped.getParticleCount()), prewarmedCount = int(prewarmed.getParticleCount());
+    printf("stepped: count %d, mean age %.3f\n", steppedCount, stepped.getMeanAge());
+    printf("prewarm: count %d, mean age %.3f\n", prewarmedCount, prewarmed.getMeanAge());
+    if (abs(prewarmedCount - steppedCount) > 0.1f * steppedCount
+        || fabsf(prewarmed.getMeanAge() - stepped.getMeanAge()) > 0.1f * stepped.getMeanAge())
+    {
+        fprintf(stderr, "prewarm() is far from the stepped update\n");
+        return 1;
+    }
+    return 0;
+}
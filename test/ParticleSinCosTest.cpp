@@ -0,0 +1,45 @@
+//Measures the max error of ParticleKernels::sinCos against libm on [-8192, 8192] for each instruction set and
+//precision, and checks it against the bounds documented in ParticleKernels.h.
+#include "../ParticleKernels.h"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+int main()
+{
+    using namespace ParticleKernels;
+    const int n = 1 << 22;
+    const float range = 8192;
+    std::vector<float> x(n), s(n), c(n);
+    for (int i = 0; i < n; i++)
+    {
+        x[i] = -range + 2 * range * (i + 0.5f) / n;
+    }
+
+    int failed = 0;
+    for (auto isa : { ISA::SCALAR, ISA::SSE2, ISA::AVX2, ISA::NEON })
+    {
+        setISA(isa);
+        if (getISA() != isa)
+        {
+            printf("%-6s not supported\n", getISAName(isa));
+            continue;
+        }
+        for (auto precision : { ParticleSystem::TrigPrecision::ACCURATE, ParticleSystem::TrigPrecision::FAST })
+        {
+            float bound = precision == ParticleSystem::TrigPrecision::ACCURATE ? 8.5e-8f : 1.3e-5f;
+            sinCos(x.data(), s.data(), c.data(), n, precision);
+            float error = 0;
+            for (int i = 0; i < n; i++)
+            {
+                error = (std::max)(error, (std::max)(fabsf(s[i] - sinf(x[i])), fabsf(c[i] - cosf(x[i]))));
+            }
+            bool ok = error <= bound;
+            failed += !ok;
+            printf("%-6s %-8s max error %.3g, bound %.3g %s\n", getISAName(isa),
+                precision == ParticleSystem::TrigPrecision::ACCURATE ? "accurate" : "fast", error, bound, ok ? "ok" : "FAILED");
+        }
+    }
+    setISA(getBestISA());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,58 @@
+//Times ParticleKernels::spawnRandom for each instruction set supported by the CPU, and checks that they all give the
+//same bits as the scalar version, as documented in ParticleKernels.h.
+#include "../ParticleKernels.h"
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+int main()
+{
+    using namespace ParticleKernels;
+    const int n = 1 << 16;
+    const int rounds = 200;
+    std::vector<float> reference(n), out(n);
+
+    int failed = 0;
+    double scalar = 0;
+    for (auto isa : { ISA::SCALAR, ISA::SSE2, ISA::AVX2, ISA::NEON })
+    {
+        setISA(isa);
+        if (getISA() != isa)
+        {
+            printf("%-6s not supported\n", getISAName(isa));
+            continue;
+        }
+        //odd sizes and serials cover the remainders of the SIMD loops, the clamp is hit at both ends
+        bool same = true;
+        for (int count : { 1, 3, 7, 13, n })
+        {
+            for (Uint32 serial : { 0u, 5u, 0xfffffff0u })
+            {
+                spawnRandom(out.data(), count, hash32(count), serial, 10, 4, 0.5f, 3.5f, 6.5f);
+                setISA(ISA::SCALAR);
+                spawnRandom(reference.data(), count, hash32(count), serial, 10, 4, 0.5f, 3.5f, 6.5f);
+                setISA(isa);
+                same = same && memcmp(reference.data(), out.data(), count * sizeof(float)) == 0;
+            }
+        }
+        failed += !same;
+
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++)
+        {
+            spawnRandom(out.data(), n, hash32(r), Uint32(r) * n, 10, 4, 0.5f, -FLT_MAX, FLT_MAX);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double rate = double(n) * rounds / seconds;
+        if (isa == ISA::SCALAR)
+        {
+            scalar = rate;
+        }
+        printf("%-6s %7.1f M numbers/s, speedup %.2f, %s\n", getISAName(isa), rate / 1e6, rate / scalar,
+            same ? "same bits as scalar" : "DIFFERENT BITS");
+    }
+    setISA(getBestISA());
+    return failed ? 1 : 0;
+}
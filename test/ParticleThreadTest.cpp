@@ -0,0 +1,52 @@
+//Toggles the viewport of a system while its simulation thread runs, build it with -fsanitize=thread to check the
+//culled activity for data races. The systems start empty, an emitter on screen must not be frozen by the culling.
+#include "../ParticleExample.h"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+static void setup(ParticleExample& p)
+{
+    p.setTexture((SDL_Texture*)1);
+    p.setPosition(512, 384);
+    p.setStyle(ParticleExample::FIRE);
+    p.setCulledActivity(ParticleSystem::Activity::FROZEN);
+}
+
+int main()
+{
+    SDL_Rect visible = { 0, 0, 1024, 768 }, away = { 5000, 5000, 100, 100 };
+
+    ParticleExample serial;
+    setup(serial);
+    serial.setViewport(&visible);
+    serial.draw();
+    serial.update();
+    if (serial.isCulled() || serial.getParticleCount() == 0)
+    {
+        fprintf(stderr, "a new emitter on screen is culled\n");
+        return 1;
+    }
+
+    ParticleExample p;
+    setup(p);
+    p.startSimulationThread(1.0f / 100);
+    int culled = 0, drawn = 0;
+    for (int i = 0; i < 400; i++)
+    {
+        p.setViewport(i / 20 % 2 ? &away : &visible);
+        p.draw();
+        culled += p.isCulled();
+        drawn += !p.isCulled();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    p.stopSimulationThread();
+
+    printf("culled %d, drawn %d, particles %d\n", culled, drawn, int(p.getParticleCount()));
+    if (culled == 0 || drawn == 0 || p.getParticleCount() == 0)
+    {
+        fprintf(stderr, "the culling does not follow the viewport\n");
+        return 1;
+    }
+    return 0;
+}